@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <omp.h>
+#include "edgedetect.h"
+#include "pgm_file.h"
+#include "trace.h"
+#include "canny/canny_fused.h"
+#include "canny/canny_hysteresis.h"
+#include "sobel/sobel_cpu.h"
+
+// Sobel or Canny on a binary PGM image too large to load whole. Horizontal
+// bands of rows are read from the input file, run through the kernels with
+// the halo rows they need, and written to the output file right away, so only
+// a few bands are in memory at any time. Rows within a band are shared among
+// the OpenMP threads.
+
+namespace {
+
+struct BandConfig {
+    std::string algorithm = "canny";
+    // rows, ring buffers and flood fill stacks held at once, in MB
+    long long memory_mb = 256;
+    std::string input_path;
+    std::string output_path;
+};
+
+BandConfig parseBandArgs(int argc, char** argv) {
+    BandConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--algorithm=", 0) == 0) {
+            config.algorithm = arg.substr(12);
+        } else if (arg.rfind("--memory=", 0) == 0) {
+            config.memory_mb = std::max(1, atoi(arg.c_str() + 9));
+        } else if (arg.rfind("-", 0) != 0) {
+            // the first path is the input, the second the output
+            (config.input_path.empty() ? config.input_path : config.output_path) = arg;
+        }
+    }
+    return config;
+}
+
+// Bytes a band needs for each of its rows and regardless of its height. Blocks
+// from the buffer pool are up to 25% larger than requested, so the budget
+// covers that rounding as well. The pool is trimmed between phases, so each
+// phase has the whole budget
+struct BandCost {
+    long long per_row;
+    long long fixed;
+};
+
+const double pool_rounding = 1.25;
+const long long float_size = sizeof(float);
+
+int bandRows(BandCost cost, long long memory_mb, int width, int height) {
+    long long budget = (long long)(memory_mb * 1024 * 1024 / pool_rounding);
+    long long rows = (budget - cost.fixed) / cost.per_row;
+    if (rows < 1) {
+        throw std::runtime_error("Memory budget of " + std::to_string(memory_mb) +
+            " MB is too small for rows of " + std::to_string(width) + " pixels");
+    }
+    return (int)std::min<long long>(rows, height);
+}
+
+int threadCount() {
+    return omp_get_max_threads();
+}
+
+// Output row y reads input rows y..y+2, so bands overlap by two input rows
+void sobelBands(PgmFile& input, PgmFile& output, const SobelConfig& sobel, int band_rows) {
+    int width = input.width;
+    int out_width = output.width;
+    int out_height = output.height;
+    bool parallel = threadCount() > 1;
+    SobelRowKernel row_kernel = getSobelRowKernel(sobel.simd);
+
+    ImageBuffer<uint8_t> pixels(width, band_rows + 2);
+    ImageBuffer<float> rows(sobel.integer ? 0 : width, band_rows + 2);
+    ImageBuffer<uint8_t> edges(out_width, band_rows);
+    for (int start_y = 0; start_y < out_height; start_y += band_rows) {
+        int end_y = std::min(out_height, start_y + band_rows);
+        int band_height = end_y - start_y;
+        ImageView<uint8_t> band_pixels = pixels.roi(0, 0, width, band_height + 2);
+        ImageView<uint8_t> band_edges = edges.roi(0, 0, out_width, band_height);
+        input.readRows(start_y, band_pixels);
+
+        if (sobel.integer) {
+            sobelIntegerCPU(band_pixels, band_edges, parallel);
+        } else {
+            ImageView<float> band_rows_view = rows.roi(0, 0, width, band_height + 2);
+            widenPixels(band_pixels, band_rows_view, false);
+            sobelCPU(band_rows_view, band_edges, row_kernel, parallel);
+        }
+        output.writeRows(start_y, band_edges);
+    }
+}
+
+// Writes the edge classes of every band, already flooded within the band.
+// Output rows [start_y, end_y) read input rows from fused_halo_above rows
+// above start_y to fusedHaloBelow rows below end_y, which are read again
+// by the neighbouring bands
+void classifyBands(PgmFile& input, PgmFile& output, const CannyConfig& canny, int band_rows) {
+    int width = input.width;
+    int height = input.height;
+    int out_width = output.width;
+    int out_height = output.height;
+    int halo_below = fusedHaloBelow(canny);
+    int halo_rows = fused_halo_above + halo_below;
+    int threads = threadCount();
+
+    ImageBuffer<uint8_t> pixels(width, band_rows + halo_rows);
+    ImageBuffer<float> rows(width, band_rows + halo_rows);
+    ImageBuffer<uint8_t> edges(out_width, band_rows);
+    for (int start_y = 0; start_y < out_height; start_y += band_rows) {
+        int end_y = std::min(out_height, start_y + band_rows);
+        int first_y = std::max(0, start_y - fused_halo_above);
+        int last_y = std::min(height, end_y + halo_below);
+        ImageView<uint8_t> band_pixels = pixels.roi(0, 0, width, last_y - first_y);
+        ImageView<float> band_rows_view = rows.roi(0, 0, width, last_y - first_y);
+        ImageView<uint8_t> band_edges = edges.roi(0, 0, out_width, end_y - start_y);
+        input.readRows(first_y, band_pixels);
+        widenPixels(band_pixels, band_rows_view, false);
+
+        // one strip of the band per thread, like cannyFused
+        int strips = std::max(1, std::min(threads, end_y - start_y));
+        #pragma omp parallel for if (strips > 1)
+        for (int i = 0; i < strips; ++i) {
+            int strip_start = start_y + (int)((long)(end_y - start_y) * i / strips);
+            int strip_end = start_y + (int)((long)(end_y - start_y) * (i + 1) / strips);
+            TRACE_SCOPE("cannyFusedBand");
+            cannyFusedBand(band_rows_view, first_y, height,
+                band_edges.roi(0, strip_start - start_y, out_width, strip_end - strip_start),
+                canny, strip_start, strip_end);
+        }
+
+        promoteWeakEdges(band_edges, 0, 0);
+        output.writeRows(start_y, band_edges);
+    }
+}
+
+// Hysteresis over the edge classes on disk. Each band is loaded with one row
+// of its neighbours on either side, flooded, and its own rows written back if
+// anything in them was promoted. A chain of weak pixels can wind through any
+// number of bands, so passes alternate downwards and upwards until one
+// promotes nothing, at which point every weak pixel next to a strong one has
+// been promoted, exactly as a flood fill over the whole image would.
+// Returns the number of passes
+int hysteresisBands(PgmFile& edges, int band_rows) {
+    TRACE_SCOPE("hysteresis");
+    int width = edges.width;
+    int height = edges.height;
+    int bands = (height + band_rows - 1) / band_rows;
+    ImageBuffer<uint8_t> rows(width, band_rows + 2);
+
+    int passes = 0;
+    bool promoted = true;
+    while (promoted) {
+        promoted = false;
+        bool downwards = passes % 2 == 0;
+        for (int i = 0; i < bands; ++i) {
+            int start_y = (downwards ? i : bands - 1 - i) * band_rows;
+            int end_y = std::min(height, start_y + band_rows);
+            int first_y = std::max(0, start_y - 1);
+            int last_y = std::min(height, end_y + 1);
+            ImageView<uint8_t> band = rows.roi(0, 0, width, last_y - first_y);
+            edges.readRows(first_y, band);
+
+            int own_start = start_y - first_y;
+            int own_end = end_y - first_y;
+            if (promoteWeakEdges(band, own_start, own_end) > 0) {
+                edges.writeRows(start_y, band.roi(0, own_start, width, end_y - start_y));
+                promoted = true;
+            }
+        }
+        ++passes;
+    }
+
+    for (int start_y = 0; start_y < height; start_y += band_rows) {
+        ImageView<uint8_t> band = rows.roi(0, 0, width, std::min(height, start_y + band_rows) - start_y);
+        edges.readRows(start_y, band);
+        dropWeakEdges(band);
+        edges.writeRows(start_y, band);
+    }
+    return passes;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    BandConfig config = parseBandArgs(argc, argv);
+    bool verbose = false;
+    EdgeParams params;
+    params.sobel = parseSobelArgs(argc, argv, &verbose);
+    params.canny = parseCannyArgs(argc, argv, &verbose);
+    std::string trace_path = parseTraceArg(argc, argv);
+
+    if (config.input_path.empty() || config.output_path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [options] <input.pgm> <output.pgm>" << std::endl;
+        return 1;
+    }
+    if (config.algorithm != "sobel" && config.algorithm != "canny") {
+        std::cerr << "Unknown algorithm [" << config.algorithm << "]" << std::endl;
+        return 1;
+    }
+    bool sobel = config.algorithm == "sobel";
+    if (!sobel && (params.canny.integer || params.canny.gaussian == GaussianMode::Full2D)) {
+        std::cerr << "Canny bands always run the fused float path, "
+            "--integer and --full-gaussian are ignored" << std::endl;
+    }
+
+    std::cout << "==========Band Processing==========" << std::endl;
+    traceStart(0, "Band Processing");
+    auto start = chrono::steady_clock::now();
+    try {
+        PgmFile input(config.input_path);
+        int width = input.width;
+        int height = input.height;
+        EdgeAlgorithm algorithm = sobel ? EdgeAlgorithm::Sobel : EdgeAlgorithm::Canny;
+        PgmFile output(config.output_path, edgeOutputWidth(algorithm, width, params),
+            edgeOutputHeight(algorithm, height, params));
+        std::cout << "Input: " << width << "x" << height << ", "
+            << config.memory_mb << " MB budget" << std::endl;
+        if (output.width <= 0 || output.height <= 0) {
+            throw std::runtime_error("Image is too small: " + config.input_path);
+        }
+
+        int threads = threadCount();
+        if (sobel) {
+            // input rows as uint8 (and float), one output row, one float row per thread
+            long long float_row = params.sobel.integer ? 0 : (long long)width * float_size;
+            BandCost cost = {width + float_row + output.width,
+                2 * (width + float_row) + (long long)threads * output.width * float_size};
+            int band_rows = bandRows(cost, config.memory_mb, width, output.height);
+            std::cout << "Bands: " << band_rows << " rows" << std::endl;
+            sobelBands(input, output, params.sobel, band_rows);
+        } else {
+            // Classification holds input rows as uint8 and float plus one edge
+            // row per output row, and each thread has its ring buffers of a
+            // Gaussian's worth of rows plus 8 float rows. Hysteresis holds one
+            // edge row and, at worst, a stack entry per pixel
+            long long input_row = width * (1 + float_size);
+            long long flood_row = (long long)output.width * (1 + 8);
+            long long ring_rows = params.canny.gaussian_size + 8;
+            BandCost classify_cost = {input_row + output.width,
+                (fused_halo_above + fusedHaloBelow(params.canny)) * input_row +
+                    (long long)threads * ring_rows * width * float_size};
+            BandCost flood_cost = {flood_row, 2 * flood_row};
+            int band_rows = bandRows(classify_cost, config.memory_mb, width, output.height);
+            int flood_rows = bandRows(flood_cost, config.memory_mb, output.width, output.height);
+            std::cout << "Bands: " << band_rows << " rows, " << flood_rows
+                << " for hysteresis" << std::endl;
+            classifyBands(input, output, params.canny, band_rows);
+            bufferPoolTrim();
+            int passes = hysteresisBands(output, flood_rows);
+            std::cout << "Hysteresis passes: " << passes << std::endl;
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    auto end = chrono::steady_clock::now();
+    auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    std::cout << "Duration: " << duration.count() << " ns" << std::endl;
+
+    BufferPoolStats pool_stats = bufferPoolStats();
+    std::cout << "Image buffers: " << pool_stats.heap_allocations << " allocated, "
+        << pool_stats.reuses << " reused" << std::endl;
+    if (!trace_path.empty()) {
+        writeTrace(trace_path);
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "benchmark.h"
+
+namespace {
+
+// nearest rank: the smallest sample with at least `percent` of the samples
+// at or below it
+long long percentile(const std::vector<long long>& sorted, double percent) {
+    size_t rank = (size_t)std::ceil(percent / 100.0 * sorted.size());
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+std::string jsonString(const std::string& value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+}
+
+StageStats summarize(std::vector<long long> samples) {
+    StageStats stats;
+    if (samples.empty()) { return stats; }
+
+    std::sort(samples.begin(), samples.end());
+    size_t count = samples.size();
+    long long total = 0;
+    for (long long sample : samples) {
+        total += sample;
+    }
+
+    stats.samples = (int)count;
+    stats.min = samples.front();
+    stats.median = count % 2 ? samples[count / 2] :
+        (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    stats.p95 = percentile(samples, 95);
+    stats.p99 = percentile(samples, 99);
+    stats.max = samples.back();
+    stats.mean = total / (long long)count;
+    return stats;
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::string mpirunCommand(const std::string& executable, int np,
+    const std::string& mpirun_args, const std::vector<std::string>& args
+) {
+    std::string command = "mpirun -np " + std::to_string(np);
+    if (!mpirun_args.empty()) {
+        command += " " + mpirun_args;
+    }
+    command += " " + executable;
+    for (const auto& arg : args) {
+        command += " " + arg;
+    }
+    return command;
+}
+
+bool runMpiCommand(const std::string& command, MpiRunTimes* times) {
+    *times = MpiRunTimes();
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) { return false; }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), pipe)) {
+        long long mean[4];
+        long long longest[4];
+        if (sscanf(line, "Duration: %lld ns", &times->duration) == 1) {
+            continue;
+        }
+        if (sscanf(line, "Wait per rank (mean / max): scatter %lld / %lld ns, "
+                "halo %lld / %lld ns, gather %lld / %lld ns, save %lld / %lld ns",
+                &mean[0], &longest[0], &mean[1], &longest[1],
+                &mean[2], &longest[2], &mean[3], &longest[3]) == 8) {
+            std::copy(mean, mean + 4, times->waits);
+        }
+    }
+    return pclose(pipe) == 0;
+}
+
+void BenchmarkReport::add(const std::string& algorithm, const std::string& backend,
+    const std::string& image, const std::string& stage,
+    const std::vector<long long>& samples
+) {
+    rows.push_back({algorithm, backend, image, stage, summarize(samples)});
+}
+
+void BenchmarkReport::print(bool per_image) const {
+    std::string last_run;
+    for (const auto& row : rows) {
+        if (row.image != "all" && !per_image) { continue; }
+
+        std::string run = row.algorithm + " " + row.backend;
+        if (run != last_run) {
+            std::cout << "----" << run << "----" << std::endl;
+            last_run = run;
+        }
+        std::cout << "  ";
+        if (row.image != "all") {
+            std::cout << "[" << row.image << "] ";
+        }
+        std::cout << row.stage << ": min " << row.stats.min
+            << " / median " << row.stats.median << " / p95 " << row.stats.p95
+            << " / p99 " << row.stats.p99 << " ns" << std::endl;
+    }
+}
+
+void BenchmarkReport::writeCSV(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to write benchmark results: " + path);
+    }
+
+    file << "algorithm,backend,image,stage,samples,min_ns,median_ns,p95_ns,p99_ns,mean_ns\n";
+    for (const auto& row : rows) {
+        const StageStats& stats = row.stats;
+        file << row.algorithm << "," << row.backend << "," << row.image << ","
+            << row.stage << "," << stats.samples << "," << stats.min << ","
+            << stats.median << "," << stats.p95 << "," << stats.p99 << ","
+            << stats.mean << "\n";
+    }
+}
+
+void BenchmarkReport::writeJSON(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to write benchmark results: " + path);
+    }
+
+    file << "{\n  \"warmup\": " << warmup << ",\n  \"reps\": " << reps
+        << ",\n  \"results\": [";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const BenchmarkRow& row = rows[i];
+        const StageStats& stats = row.stats;
+        file << (i == 0 ? "\n" : ",\n") << "    {\"algorithm\": " << jsonString(row.algorithm)
+            << ", \"backend\": " << jsonString(row.backend)
+            << ", \"image\": " << jsonString(row.image)
+            << ", \"stage\": " << jsonString(row.stage)
+            << ", \"samples\": " << stats.samples << ", \"min_ns\": " << stats.min
+            << ", \"median_ns\": " << stats.median << ", \"p95_ns\": " << stats.p95
+            << ", \"p99_ns\": " << stats.p99 << ", \"mean_ns\": " << stats.mean << "}";
+    }
+    file << "\n  ]\n}\n";
+}
@@ -0,0 +1,69 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <string>
+#include <vector>
+
+// Distribution of one timed stage over the measured repetitions, in
+// nanoseconds. Percentiles use the nearest rank, so they are always one of
+// the samples
+struct StageStats {
+    int samples = 0;
+    long long min = 0;
+    long long median = 0;
+    long long p95 = 0;
+    long long p99 = 0;
+    long long max = 0;
+    long long mean = 0;
+};
+
+StageStats summarize(std::vector<long long> samples);
+
+// the items of a comma separated flag value, empty items dropped
+std::vector<std::string> splitList(const std::string& list);
+
+// The mpirun command line of an MPI executable: `np` ranks, then mpirun_args,
+// which is where rank mapping and binding go, then the executable's arguments
+std::string mpirunCommand(const std::string& executable, int np,
+    const std::string& mpirun_args, const std::vector<std::string>& args);
+
+// What an MPI executable printed about its run, -1 where a line was missing.
+// Waits are the mean per rank of the scatter, halo, gather and save phases
+struct MpiRunTimes {
+    long long duration = -1;
+    long long waits[4] = {-1, -1, -1, -1};
+};
+
+// Runs `command` and reads the Duration and wait lines from its output. False
+// if it could not be started or exited with an error
+bool runMpiCommand(const std::string& command, MpiRunTimes* times);
+
+// one line of the report. image is "all" for the sum over every image of a
+// repetition, and for runs that only report whole-run times
+struct BenchmarkRow {
+    std::string algorithm;
+    std::string backend;
+    std::string image;
+    std::string stage;
+    StageStats stats;
+};
+
+struct BenchmarkReport {
+    int warmup = 0;
+    int reps = 0;
+    std::vector<BenchmarkRow> rows;
+
+    void add(const std::string& algorithm, const std::string& backend,
+        const std::string& image, const std::string& stage,
+        const std::vector<long long>& samples);
+
+    // prints the "all" rows, and with per_image every image as well
+    void print(bool per_image) const;
+
+    // one row per line under a header, or one JSON document with the run
+    // settings and an array of rows. Throw std::runtime_error if the file
+    // cannot be written
+    void writeCSV(const std::string& path) const;
+    void writeJSON(const std::string& path) const;
+};
+
+#endif
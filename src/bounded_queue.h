@@ -0,0 +1,101 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// Fixed-capacity multi-producer multi-consumer queue without locks. Every cell
+// carries a sequence number that tells producers and consumers whose turn it
+// is, so a push or pop is one CAS on the shared position plus one store to the
+// cell (Dmitry Vyukov's bounded MPMC queue). tryPush and tryPop never block,
+// callers decide how to wait.
+template <typename T>
+struct BoundedQueue {
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t capacity;
+    // producers and consumers each get their own cache line
+    alignas(64) std::atomic<size_t> push_position;
+    alignas(64) std::atomic<size_t> pop_position;
+
+    // with a single cell a filled cell would look free to the next push, so
+    // the queue always has room for at least two values
+    explicit BoundedQueue(size_t requested_capacity):
+        capacity(requested_capacity < 2 ? 2 : requested_capacity),
+        push_position(0), pop_position(0)
+    {
+        cells.reset(new Cell[capacity]);
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool tryPush(const T& value) {
+        size_t position = push_position.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position % capacity];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                // the cell is free for this position, claim it
+                if (push_position.compare_exchange_weak(position, position + 1,
+                        std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position) {
+                // the cell still holds the value from one lap ago: full
+                return false;
+            } else {
+                position = push_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T* value) {
+        size_t position = pop_position.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position % capacity];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position + 1) {
+                if (pop_position.compare_exchange_weak(position, position + 1,
+                        std::memory_order_relaxed)) {
+                    *value = cell.value;
+                    // free the cell for the push one lap later
+                    cell.sequence.store(position + capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position + 1) {
+                // nothing has been pushed for this position yet: empty
+                return false;
+            } else {
+                position = pop_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// queues never block, so waiting threads spin briefly and then back off to
+// short sleeps, which keeps idle decode/encode threads off the compute cores
+struct Backoff {
+    int spins = 0;
+
+    void wait() {
+        if (++spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+};
+
+#endif
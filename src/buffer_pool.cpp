@@ -0,0 +1,159 @@
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "buffer_pool.h"
+#include "image_buffer.h"
+
+namespace {
+
+// (64 bytes and below) + 4 classes for each power of two up to 2^63
+const int class_count = 1 + 4 * 58;
+// blocks per class a thread keeps to itself before sharing them
+const int thread_cache_blocks = 4;
+
+std::atomic<size_t> heap_allocations(0);
+std::atomic<size_t> reuses(0);
+std::atomic<size_t> heap_frees(0);
+// bumped by bufferPoolTrim, a thread cache from an older trim empties itself
+std::atomic<unsigned> trim_generation(0);
+
+// class of a request and the bytes every block of that class holds
+int sizeClass(size_t bytes, size_t* class_bytes) {
+    if (bytes <= image_alignment) {
+        *class_bytes = image_alignment;
+        return 0;
+    }
+    // 2^power < bytes <= 2^(power+1), split into quarters of 2^power
+    int power = 63 - __builtin_clzll(bytes - 1);
+    size_t step = ((size_t)1 << power) / 4;
+    size_t steps = (bytes + step - 1) / step;
+    // aligned_alloc wants a multiple of the alignment
+    *class_bytes = (steps * step + image_alignment - 1) / image_alignment * image_alignment;
+    return 1 + (power - 6) * 4 + (int)(steps - 5);
+}
+
+struct SharedPool {
+    std::mutex locks[class_count];
+    std::vector<void*> blocks[class_count];
+
+    ~SharedPool() {
+        for (auto& class_blocks : blocks) {
+            for (void* block : class_blocks) {
+                std::free(block);
+            }
+        }
+    }
+};
+
+SharedPool& sharedPool() {
+    static SharedPool pool;
+    return pool;
+}
+
+struct ThreadCache {
+    void* blocks[class_count][thread_cache_blocks];
+    int counts[class_count] = {};
+    unsigned generation = trim_generation.load(std::memory_order_relaxed);
+
+    void trim() {
+        for (int i = 0; i < class_count; ++i) {
+            for (int j = 0; j < counts[i]; ++j) {
+                std::free(blocks[i][j]);
+            }
+            heap_frees.fetch_add(counts[i], std::memory_order_relaxed);
+            counts[i] = 0;
+        }
+        generation = trim_generation.load(std::memory_order_relaxed);
+    }
+
+    // a thread that exits hands its blocks to everyone else
+    ~ThreadCache() {
+        SharedPool& pool = sharedPool();
+        for (int i = 0; i < class_count; ++i) {
+            if (counts[i] == 0) { continue; }
+            std::lock_guard<std::mutex> guard(pool.locks[i]);
+            pool.blocks[i].insert(pool.blocks[i].end(), blocks[i], blocks[i] + counts[i]);
+        }
+    }
+};
+
+ThreadCache& threadCache() {
+    // the shared pool must outlive every thread cache
+    sharedPool();
+    thread_local ThreadCache cache;
+    if (cache.generation != trim_generation.load(std::memory_order_relaxed)) {
+        cache.trim();
+    }
+    return cache;
+}
+
+}
+
+void* poolAllocate(size_t bytes) {
+    size_t class_bytes;
+    int index = sizeClass(bytes, &class_bytes);
+
+    ThreadCache& cache = threadCache();
+    if (cache.counts[index] > 0) {
+        reuses.fetch_add(1, std::memory_order_relaxed);
+        return cache.blocks[index][--cache.counts[index]];
+    }
+
+    SharedPool& pool = sharedPool();
+    {
+        std::lock_guard<std::mutex> guard(pool.locks[index]);
+        if (!pool.blocks[index].empty()) {
+            void* block = pool.blocks[index].back();
+            pool.blocks[index].pop_back();
+            reuses.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+
+    void* block = std::aligned_alloc(image_alignment, class_bytes);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+void poolRelease(void* data, size_t bytes) {
+    if (!data) { return; }
+    size_t class_bytes;
+    int index = sizeClass(bytes, &class_bytes);
+
+    ThreadCache& cache = threadCache();
+    if (cache.counts[index] < thread_cache_blocks) {
+        cache.blocks[index][cache.counts[index]++] = data;
+        return;
+    }
+
+    SharedPool& pool = sharedPool();
+    std::lock_guard<std::mutex> guard(pool.locks[index]);
+    pool.blocks[index].push_back(data);
+}
+
+BufferPoolStats bufferPoolStats() {
+    return {heap_allocations.load(), reuses.load(), heap_frees.load()};
+}
+
+void bufferPoolTrim() {
+    trim_generation.fetch_add(1, std::memory_order_relaxed);
+    threadCache();
+
+    SharedPool& pool = sharedPool();
+    for (int i = 0; i < class_count; ++i) {
+        std::vector<void*> class_blocks;
+        {
+            std::lock_guard<std::mutex> guard(pool.locks[i]);
+            class_blocks.swap(pool.blocks[i]);
+        }
+        for (void* block : class_blocks) {
+            std::free(block);
+        }
+        heap_frees.fetch_add(class_blocks.size(), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+#include <cstddef>
+
+// Recycles the aligned blocks behind ImageBuffer. Requests are rounded up to
+// one of four size classes per power of two, so a block is at most 25% larger
+// than asked for. Freed blocks go to a small cache of the calling thread and
+// overflow into a shared pool, which is where threads that only allocate
+// (like decoders) pick up blocks freed by threads that only free (like
+// encoders). Blocks go back to the heap only in bufferPoolTrim, so once
+// every size an executable uses has been seen, processing another image
+// allocates nothing.
+
+struct BufferPoolStats {
+    // blocks that had to come from aligned_alloc
+    size_t heap_allocations;
+    // requests served with a recycled block
+    size_t reuses;
+    // blocks handed back to the heap by bufferPoolTrim
+    size_t heap_frees;
+};
+
+// throws std::bad_alloc like ImageBuffer did before the pool
+void* poolAllocate(size_t bytes);
+
+// `bytes` must be the size the block was requested with
+void poolRelease(void* data, size_t bytes);
+
+BufferPoolStats bufferPoolStats();
+
+// Frees every cached block. The shared pool and the calling thread's cache
+// are emptied right away, other threads empty their caches on their next
+// allocation or release. Drivers that move on to images of another size call
+// this between sizes, so the pool does not keep the peak of every size
+void bufferPoolTrim();
+
+#endif
@@ -1,30 +1,323 @@
 #ifndef CANNY_H
 #define CANNY_H
 #include <cstring>
+#include <cstdlib>
 #include <cmath>
 #include <chrono>
-#include "../gray_image.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include "../image_buffer.h"
 
 namespace chrono = std::chrono;
 
-const int sobel_x[3][3] = {
-    {-1, 0, 1},
-    {-2, 0, 2},
-    {-1, 0, 1}
+// gradients are always 3x3, the Gaussian is config.gaussian_size wide
+const int gradient_kernel_size = 3;
+
+// Odd Gaussian sizes up to this are accepted. The common sizes have loops
+// specialized for them, see dispatchGaussianSize
+const int max_gaussian_kernel_size = 15;
+
+// std::exp is not constexpr, so the kernels below use a Taylor series instead.
+// x is halved until the series converges fast, then the result is squared back
+constexpr double constexprExp(double x) {
+    int halvings = 0;
+    while (x < -0.5 || x > 0.5) {
+        x /= 2;
+        ++halvings;
+    }
+
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n < 20; ++n) {
+        term *= x / n;
+        sum += term;
+    }
+
+    for (int i = 0; i < halvings; ++i) {
+        sum *= sum;
+    }
+    return sum;
+}
+
+// Normalized weights of a size x size Gaussian. The 2D kernel is the outer
+// product of the 1D one, but normalized on its own, so each matches what a
+// direct computation of that kernel gives. Only the first `size` entries of
+// each dimension are used
+struct GaussianKernel {
+    int size;
+    float weights_1d[max_gaussian_kernel_size];
+    float weights_2d[max_gaussian_kernel_size][max_gaussian_kernel_size];
+};
+
+constexpr GaussianKernel makeGaussianKernel(int size, double sd) {
+    GaussianKernel kernel{};
+    kernel.size = size;
+    int radius = size / 2;
+
+    double values[max_gaussian_kernel_size] = {};
+    double sum = 0.0;
+    for (int i = 0; i < size; ++i) {
+        int x = i - radius;
+        values[i] = constexprExp(-(x * x) / (2 * sd * sd));
+        sum += values[i];
+    }
+    for (int i = 0; i < size; ++i) {
+        kernel.weights_1d[i] = (float)(values[i] / sum);
+    }
+
+    double values_2d[max_gaussian_kernel_size][max_gaussian_kernel_size] = {};
+    double sum_2d = 0.0;
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+            int y = i - radius;
+            int x = j - radius;
+            values_2d[i][j] = constexprExp(-(x * x + y * y) / (2 * sd * sd));
+            sum_2d += values_2d[i][j];
+        }
+    }
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+            kernel.weights_2d[i][j] = (float)(values_2d[i][j] / sum_2d);
+        }
+    }
+    return kernel;
+}
+
+// Size of `kernel` in a loop specialized for Size, which is 0 in the loop for
+// every other size. The compiler sees a constant for the specialized sizes,
+// so it can unroll over the weights and keep them in registers
+template <int Size>
+inline int gaussianSize(const GaussianKernel& kernel) {
+    return Size > 0 ? Size : kernel.size;
+}
+
+// Calls stage(std::integral_constant<int, Size>()) with the Gaussian size
+// when it has a specialized loop, and with 0 otherwise
+template <typename Stage>
+void dispatchGaussianSize(int size, Stage stage) {
+    switch (size) {
+    case 3: stage(std::integral_constant<int, 3>()); break;
+    case 5: stage(std::integral_constant<int, 5>()); break;
+    case 7: stage(std::integral_constant<int, 7>()); break;
+    default: stage(std::integral_constant<int, 0>()); break;
+    }
+}
+
+enum class GradientOperator {
+    Sobel,
+    // weights 3, 10, 3: closer to rotation invariant, with gradients about
+    // 4 times those of Sobel, so thresholds need to grow as well
+    Scharr,
+    // weights 1, 1, 1, gradients about 3/4 of Sobel
+    Prewitt
+};
+
+// x and y derivative kernels of an operator. The x kernel subtracts the left
+// column from the right one, y is its transpose
+struct GradientKernel {
+    int x[3][3];
+    int y[3][3];
+};
+
+constexpr GradientKernel makeGradientKernel(GradientOperator op) {
+    int side = op == GradientOperator::Scharr ? 3 : 1;
+    int centre = op == GradientOperator::Sobel ? 2 :
+                 op == GradientOperator::Scharr ? 10 : 1;
+    int weights[3] = {side, centre, side};
+
+    GradientKernel kernel{};
+    for (int i = 0; i < 3; ++i) {
+        kernel.x[i][0] = -weights[i];
+        kernel.x[i][2] = weights[i];
+        kernel.y[0][i] = -weights[i];
+        kernel.y[2][i] = weights[i];
+    }
+    return kernel;
+}
+
+template <GradientOperator Op>
+using GradientOperatorConstant = std::integral_constant<GradientOperator, Op>;
+
+// Calls stage(GradientOperatorConstant<Op>()), so gradient loops see the
+// operator's weights as constants
+template <typename Stage>
+void dispatchGradientOperator(GradientOperator op, Stage stage) {
+    switch (op) {
+    case GradientOperator::Sobel: stage(GradientOperatorConstant<GradientOperator::Sobel>()); break;
+    case GradientOperator::Scharr: stage(GradientOperatorConstant<GradientOperator::Scharr>()); break;
+    case GradientOperator::Prewitt: stage(GradientOperatorConstant<GradientOperator::Prewitt>()); break;
+    }
+}
+
+// Gradient direction quantized to the pair of neighbours non-maximum
+// suppression compares against
+enum DirectionSector : uint8_t {
+    sector_0 = 0,   // left and right
+    sector_45 = 1,  // upper left and lower right
+    sector_90 = 2,  // above and below
+    sector_135 = 3  // upper right and lower left
+};
+
+// first neighbour of each DirectionSector as (dy, dx), the second one is mirrored
+const int sector_offsets[4][2] = {
+    {0, -1},
+    {-1, -1},
+    {-1, 0},
+    {-1, 1}
+};
+
+// Sector boundaries sit at 22.5 and 67.5 degrees from the x axis, so instead
+// of atan2 the sector is found by comparing |gy| against |gx| * tan(boundary)
+const float tan_22_5 = 0.41421356f;
+const float tan_67_5 = 2.41421356f;
+
+inline DirectionSector directionSector(float sum_x, float sum_y) {
+    float abs_x = std::abs(sum_x);
+    float abs_y = std::abs(sum_y);
+    if (abs_y <= tan_22_5 * abs_x) {
+        return sector_0;
+    }
+    if (abs_y >= tan_67_5 * abs_x) {
+        return sector_90;
+    }
+    // y grows downwards, so equal signs point along the main diagonal
+    return ((sum_x < 0) == (sum_y < 0)) ? sector_45 : sector_135;
+}
+
+// the same tangents in Q15 for integer gradients
+const int sector_tan_bits = 15;
+const int sector_tan_22_5 = 13573;
+const int sector_tan_67_5 = 79109;
+
+inline DirectionSector directionSector(int sum_x, int sum_y) {
+    int abs_x = std::abs(sum_x);
+    int abs_y = std::abs(sum_y);
+    if (abs_y * (1 << sector_tan_bits) <= sector_tan_22_5 * abs_x) {
+        return sector_0;
+    }
+    if (abs_y * (1 << sector_tan_bits) >= sector_tan_67_5 * abs_x) {
+        return sector_90;
+    }
+    // y grows downwards, so equal signs point along the main diagonal
+    return ((sum_x ^ sum_y) >= 0) ? sector_45 : sector_135;
+}
+
+enum class GaussianMode {
+    // full 2D convolution, gaussian_size^2 MACs per pixel
+    Full2D,
+    // horizontal then vertical 1D pass, 2 * gaussian_size MACs per pixel.
+    // Only the float summation order differs from Full2D: smoothed pixels stay
+    // within 1e-3 of it, so final edges only change where a gradient sits
+    // exactly on a threshold
+    Separable
 };
 
-const int sobel_y[3][3] = {
-    {-1, -2, -1},
-    {0, 0, 0},
-    {1, 2, 1}
+enum class CannyExecution {
+    // one full-image pass per stage
+    Staged,
+    // rows streamed through all stages with a few rows of buffering per stage,
+    // see canny_fused.h. Always smooths with the separable Gaussian
+    Fused
 };
 
-const int sobel_kernel_size = 3;
-const int gaussian_kernel_size = 5;
-const double gaussian_sd = 1.0;
+struct CannyConfig {
+    GaussianMode gaussian = GaussianMode::Separable;
+    CannyExecution execution = CannyExecution::Staged;
+    // uint8 pixels with fixed-point stages instead of floats, see canny_int.h.
+    // Always separable and staged
+    bool integer = false;
+    // odd, at most max_gaussian_kernel_size. Every Gaussian size - 1 shrinks
+    // the edge image by one more row and column
+    int gaussian_size = 5;
+    double gaussian_sd = 1.0;
+    // on the gradient magnitude, which depends on the operator
+    float low_threshold = 50.0f;
+    float high_threshold = 100.0f;
+    GradientOperator gradient = GradientOperator::Sobel;
+};
+
+// No gradient magnitude of a uint8 image gets past this with any operator:
+// Scharr components reach 16 * 255, and sqrt(2) * 16 * 255 < 5770. Its square
+// still fits the int32 magnitudes of the integer path
+const float max_gradient_magnitude = 5770.0f;
 
-const float low_threshold = 50.0f;
-const float high_threshold = 100.0f;
+// empty if the kernels can run with config, otherwise what is wrong with it
+inline std::string cannyConfigError(const CannyConfig& config) {
+    if (config.gaussian_size < 1 || config.gaussian_size > max_gaussian_kernel_size ||
+            config.gaussian_size % 2 == 0) {
+        return "Gaussian size must be odd and at most " +
+            std::to_string(max_gaussian_kernel_size) + ", got " +
+            std::to_string(config.gaussian_size);
+    }
+    if (!(config.gaussian_sd > 0.0)) {
+        return "Gaussian sigma must be positive";
+    }
+    if (!(config.low_threshold >= 0.0f && config.high_threshold <= max_gradient_magnitude)) {
+        return "Thresholds must be between 0 and " +
+            std::to_string((int)max_gradient_magnitude);
+    }
+    if (!(config.low_threshold <= config.high_threshold)) {
+        return "Low threshold must not be above the high threshold";
+    }
+    return "";
+}
+
+inline bool parseGradientOperator(const std::string& name, GradientOperator* op) {
+    if (name == "sobel") {
+        *op = GradientOperator::Sobel;
+    } else if (name == "scharr") {
+        *op = GradientOperator::Scharr;
+    } else if (name == "prewitt") {
+        *op = GradientOperator::Prewitt;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// flags shared by every Canny executable
+inline CannyConfig parseCannyArgs(int argc, char** argv, bool* verbose) {
+    CannyConfig config;
+    *verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "-v" || arg == "--verbose") {
+            *verbose = true;
+        } else if (arg == "--full-gaussian") {
+            config.gaussian = GaussianMode::Full2D;
+        } else if (arg == "--fused") {
+            config.execution = CannyExecution::Fused;
+        } else if (arg == "--integer") {
+            config.integer = true;
+        } else if (arg.rfind("--gaussian-size=", 0) == 0) {
+            config.gaussian_size = atoi(arg.c_str() + 16);
+        } else if (arg.rfind("--sigma=", 0) == 0) {
+            config.gaussian_sd = atof(arg.c_str() + 8);
+        } else if (arg.rfind("--low-threshold=", 0) == 0) {
+            config.low_threshold = (float)atof(arg.c_str() + 16);
+        } else if (arg.rfind("--high-threshold=", 0) == 0) {
+            config.high_threshold = (float)atof(arg.c_str() + 17);
+        } else if (arg.rfind("--operator=", 0) == 0) {
+            if (!parseGradientOperator(arg.substr(11), &config.gradient)) {
+                std::cerr << "Unknown gradient operator [" << arg.substr(11)
+                    << "], using sobel" << std::endl;
+            }
+        }
+    }
+
+    std::string error = cannyConfigError(config);
+    if (!error.empty()) {
+        std::cerr << error << ", using the default Gaussian and thresholds" << std::endl;
+        CannyConfig defaults;
+        config.gaussian_size = defaults.gaussian_size;
+        config.gaussian_sd = defaults.gaussian_sd;
+        config.low_threshold = defaults.low_threshold;
+        config.high_threshold = defaults.high_threshold;
+    }
+    return config;
+}
 
 inline int getOutputHeight(int image_height, int kernel_size) {
     return image_height - kernel_size + 1;
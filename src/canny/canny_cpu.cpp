@@ -0,0 +1,310 @@
+#include <omp.h>
+#include "canny_cpu.h"
+#include "canny_fused.h"
+#include "canny_hysteresis.h"
+#include "canny_int.h"
+#include "../trace.h"
+
+namespace {
+
+// Specialized for a Gaussian size, or 0 for any size, see dispatchGaussianSize
+template <int Size>
+void gaussianFilterFullRows(ImageView<const float> image, ImageView<float> new_image,
+    const GaussianKernel& kernel, int start_y, int end_y
+) {
+    const auto& gaussian_kernel = kernel.weights_2d;
+    const int size = gaussianSize<Size>(kernel);
+    int new_width = new_image.width;
+
+    for (int y = start_y; y < end_y; ++y) {
+        float* output_row = new_image[y];
+        for (int x = 0; x < new_width; ++x) {
+            float magnitude = 0.0f;
+            for (int i = 0; i < size; ++i) {
+                const float* input_row = image[y+i];
+                for (int j = 0; j < size; ++j) {
+                    magnitude += gaussian_kernel[i][j] * input_row[x+j];
+                }
+            }
+            output_row[x] = magnitude;
+        }
+    }
+}
+
+template <int Size>
+void gaussianFilterSeparableRows(ImageView<const float> image, ImageView<float> new_image,
+    const GaussianKernel& kernel, int start_y, int end_y
+) {
+    const auto& gaussian_kernel = kernel.weights_1d;
+    const int size = gaussianSize<Size>(kernel);
+    int height = end_y - start_y;
+    int new_width = new_image.width;
+
+    // horizontal pass over the rows plus the rows the vertical pass needs below them
+    int horizontal_height = height + size - 1;
+    ImageBuffer<float> horizontal(new_width, horizontal_height);
+    for (int y = 0; y < horizontal_height; ++y) {
+        const float* input_row = image[start_y + y];
+        float* output_row = horizontal[y];
+        for (int x = 0; x < new_width; ++x) {
+            float magnitude = 0.0f;
+            for (int j = 0; j < size; ++j) {
+                magnitude += gaussian_kernel[j] * input_row[x+j];
+            }
+            output_row[x] = magnitude;
+        }
+    }
+
+    // vertical pass, accumulating whole rows so the inner loop is contiguous
+    for (int y = 0; y < height; ++y) {
+        float* output_row = new_image[start_y + y];
+        for (int x = 0; x < new_width; ++x) {
+            output_row[x] = 0.0f;
+        }
+        for (int i = 0; i < size; ++i) {
+            const float* input_row = horizontal[y+i];
+            for (int x = 0; x < new_width; ++x) {
+                output_row[x] += gaussian_kernel[i] * input_row[x];
+            }
+        }
+    }
+}
+
+template <GradientOperator Op>
+void computeGradientRowsWith(ImageView<const float> image, ImageView<float> new_image,
+    ImageView<uint8_t> direction, int start_y, int end_y
+) {
+    constexpr GradientKernel kernel = makeGradientKernel(Op);
+    int new_width = new_image.width;
+
+    for (int y = start_y; y < end_y; ++y) {
+        float* output_row = new_image[y];
+        uint8_t* direction_row = direction[y];
+        for (int x = 0; x < new_width; ++x) {
+            float sum_x = 0.0f;
+            float sum_y = 0.0f;
+
+            for (int i = 0; i < 3; ++i) {
+                const float* input_row = image[y+i];
+                for (int j = 0; j < 3; ++j) {
+                    sum_x += kernel.x[i][j] * input_row[x+j];
+                    sum_y += kernel.y[i][j] * input_row[x+j];
+                }
+            }
+
+            output_row[x] = std::sqrt(sum_x * sum_x + sum_y * sum_y);
+            direction_row[x] = directionSector(sum_x, sum_y);
+        }
+    }
+}
+
+// weak pixels survive if a chain of weak pixels leads to a strong one
+void hysteresisTiles(ImageView<uint8_t> edges, int tiles) {
+    TRACE_SCOPE("hysteresis");
+    if (tiles > 1) {
+        hysteresisUnionFind(edges, tiles);
+    } else {
+        hysteresisFloodFill(edges);
+    }
+}
+
+// one horizontal strip per thread, each strip streams its rows through its
+// own ring buffers and recomputes the few halo rows above it
+void cannyFused(ImageView<const float> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel
+) {
+    TRACE_SCOPE("cannyFused");
+    int height = edges.height;
+    int strips = parallel ? std::max(1, std::min(omp_get_max_threads(), height)) : 1;
+
+    #pragma omp parallel for if (parallel)
+    for (int i = 0; i < strips; ++i) {
+        int start_y = (int)((long)height * i / strips);
+        int end_y = (int)((long)height * (i + 1) / strips);
+        // one span per strip, on the track of the thread that ran it
+        TRACE_SCOPE("cannyFusedRows");
+        cannyFusedRows(input, edges, config, start_y, end_y);
+    }
+    hysteresisTiles(edges, strips);
+}
+
+// splits rows [0, height) into one block per thread, the stages work on row
+// ranges and only the separable Gaussians recompute a few rows per block
+template <typename Stage>
+void forEachRowBlock(int height, bool parallel, Stage stage) {
+    int blocks = parallel ? std::max(1, std::min(omp_get_max_threads(), height)) : 1;
+
+    #pragma omp parallel for if (parallel)
+    for (int i = 0; i < blocks; ++i) {
+        int start_y = (int)((long)height * i / blocks);
+        int end_y = (int)((long)height * (i + 1) / blocks);
+        stage(start_y, end_y);
+    }
+}
+
+}
+
+void gaussianFilterRows(ImageView<const float> image, ImageView<float> output,
+    const GaussianKernel& kernel, GaussianMode mode, int start_y, int end_y
+) {
+    dispatchGaussianSize(kernel.size, [&](auto size) {
+        constexpr int Size = decltype(size)::value;
+        if (mode == GaussianMode::Separable) {
+            gaussianFilterSeparableRows<Size>(image, output, kernel, start_y, end_y);
+        } else {
+            gaussianFilterFullRows<Size>(image, output, kernel, start_y, end_y);
+        }
+    });
+}
+
+void computeGradientRows(ImageView<const float> image, ImageView<float> magnitude,
+    ImageView<uint8_t> direction, GradientOperator op, int start_y, int end_y
+) {
+    dispatchGradientOperator(op, [&](auto fixed_op) {
+        computeGradientRowsWith<decltype(fixed_op)::value>(image, magnitude, direction,
+            start_y, end_y);
+    });
+}
+
+void nonMaxSuppressionRows(ImageView<const float> image, ImageView<const uint8_t> direction,
+    ImageView<float> output, int start_y, int end_y
+) {
+    int width = image.width;
+
+    for (int y = start_y; y < end_y; ++y) {
+        if (y == 0 || y == image.height - 1) {
+            // border rows lack a neighbour on one side, keep them as is
+            memcpy(output[y], image[y], width * sizeof(float));
+            continue;
+        }
+        output[y][0] = image[y][0];
+        output[y][width-1] = image[y][width-1];
+
+        const float* rows[3] = {image[y-1], image[y], image[y+1]};
+        const uint8_t* direction_row = direction[y];
+
+        for (int x = 1; x < width-1; ++x) {
+            // the sector picks the neighbours by table lookup instead of branching
+            int dy = sector_offsets[direction_row[x]][0];
+            int dx = sector_offsets[direction_row[x]][1];
+            float magnitude = rows[1][x];
+            float first_pixel = rows[1 + dy][x + dx];
+            float second_pixel = rows[1 - dy][x - dx];
+            bool keep = magnitude >= first_pixel && magnitude >= second_pixel;
+            output[y][x] = keep ? magnitude : 0.0f;
+        }
+    }
+}
+
+ImageBuffer<float> gaussianFilter(ImageView<const float> image, const CannyConfig& config,
+    bool parallel
+) {
+    TRACE_SCOPE("gaussianFilter");
+    GaussianKernel kernel = makeGaussianKernel(config.gaussian_size, config.gaussian_sd);
+    ImageBuffer<float> smoothed(getOutputWidth(image.width, kernel.size),
+        getOutputHeight(image.height, kernel.size));
+    forEachRowBlock(smoothed.height, parallel, [&](int start_y, int end_y) {
+        gaussianFilterRows(image, smoothed.view(), kernel, config.gaussian, start_y, end_y);
+    });
+    return smoothed;
+}
+
+ImageBuffer<float> computeGradients(ImageView<const float> image,
+    ImageBuffer<uint8_t>* direction, const CannyConfig& config, bool parallel
+) {
+    TRACE_SCOPE("computeGradients");
+    int new_width = getOutputWidth(image.width, gradient_kernel_size);
+    int new_height = getOutputHeight(image.height, gradient_kernel_size);
+    ImageBuffer<float> magnitude(new_width, new_height);
+    *direction = ImageBuffer<uint8_t>(new_width, new_height);
+    forEachRowBlock(new_height, parallel, [&](int start_y, int end_y) {
+        computeGradientRows(image, magnitude.view(), direction->view(), config.gradient,
+            start_y, end_y);
+    });
+    return magnitude;
+}
+
+ImageBuffer<float> nonMaxSuppression(ImageView<const float> image,
+    ImageView<const uint8_t> direction, bool parallel
+) {
+    TRACE_SCOPE("nonMaxSuppression");
+    ImageBuffer<float> suppressed(image.width, image.height);
+    forEachRowBlock(image.height, parallel, [&](int start_y, int end_y) {
+        nonMaxSuppressionRows(image, direction, suppressed.view(), start_y, end_y);
+    });
+    return suppressed;
+}
+
+void doubleThreshold(ImageView<const float> image, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel
+) {
+    TRACE_SCOPE("doubleThreshold");
+    #pragma omp parallel for if (parallel)
+    for (int y = 0; y < image.height; ++y) {
+        classifyEdgeRows(image, edges, config, y, y + 1);
+    }
+}
+
+void hysteresis(ImageView<uint8_t> edges, bool parallel) {
+    hysteresisTiles(edges, parallel ? omp_get_max_threads() : 1);
+}
+
+void cannyCPU(ImageView<const float> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel
+) {
+    if (config.execution == CannyExecution::Fused) {
+        cannyFused(input, edges, config, parallel);
+        return;
+    }
+
+    ImageBuffer<float> smoothed = gaussianFilter(input, config, parallel);
+    ImageBuffer<uint8_t> direction;
+    ImageBuffer<float> magnitude = computeGradients(smoothed.view(), &direction, config,
+        parallel);
+    ImageBuffer<float> suppressed = nonMaxSuppression(magnitude.view(), direction.view(), parallel);
+    doubleThreshold(suppressed.view(), edges, config, parallel);
+    hysteresis(edges, parallel);
+}
+
+void cannyIntegerCPU(ImageView<const uint8_t> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel
+) {
+    GaussianFixedKernel gaussian = makeGaussianFixedKernel(config);
+    ImageBuffer<uint8_t> smoothed(getOutputWidth(input.width, gaussian.size),
+        getOutputHeight(input.height, gaussian.size));
+    {
+        TRACE_SCOPE("gaussianFilter");
+        forEachRowBlock(smoothed.height, parallel, [&](int start_y, int end_y) {
+            gaussianIntegerRows(input, smoothed.view(), gaussian, start_y, end_y);
+        });
+    }
+
+    int width = edges.width;
+    int height = edges.height;
+    ImageBuffer<int32_t> magnitude(width, height);
+    ImageBuffer<uint8_t> direction(width, height);
+    {
+        TRACE_SCOPE("computeGradients");
+        forEachRowBlock(height, parallel, [&](int start_y, int end_y) {
+            gradientIntegerRows(smoothed.view(), magnitude.view(), direction.view(),
+                config.gradient, start_y, end_y);
+        });
+    }
+
+    ImageBuffer<int32_t> suppressed(width, height);
+    {
+        TRACE_SCOPE("nonMaxSuppression");
+        forEachRowBlock(height, parallel, [&](int start_y, int end_y) {
+            nonMaxSuppressionIntegerRows(magnitude.view(), direction.view(),
+                suppressed.view(), start_y, end_y);
+        });
+    }
+
+    {
+        TRACE_SCOPE("doubleThreshold");
+        forEachRowBlock(height, parallel, [&](int start_y, int end_y) {
+            doubleThresholdIntegerRows(suppressed.view(), edges, config, start_y, end_y);
+        });
+    }
+    hysteresis(edges, parallel);
+}
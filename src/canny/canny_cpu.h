@@ -0,0 +1,50 @@
+#ifndef CANNY_CPU_H
+#define CANNY_CPU_H
+#include "canny.h"
+
+// Canny over a whole image on the CPU, staged or fused as config says. Edges
+// are getFusedOutputWidth/Height of the input and hold edge_none or
+// edge_strong. With `parallel`, rows are shared among the OpenMP threads and
+// hysteresis uses the union-find labelling, otherwise everything runs on the
+// calling thread with the flood fill. Both give the same edges.
+void cannyCPU(ImageView<const float> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel);
+
+// the fixed-point pipeline from canny_int.h, same split of the work
+void cannyIntegerCPU(ImageView<const uint8_t> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel);
+
+// The float stages of the staged path, in the order cannyCPU runs them, for
+// timing them one at a time. Each takes the output of the one before and
+// reads the parts of config it needs
+ImageBuffer<float> gaussianFilter(ImageView<const float> image, const CannyConfig& config,
+    bool parallel);
+ImageBuffer<float> computeGradients(ImageView<const float> image,
+    ImageBuffer<uint8_t>* direction, const CannyConfig& config, bool parallel);
+ImageBuffer<float> nonMaxSuppression(ImageView<const float> image,
+    ImageView<const uint8_t> direction, bool parallel);
+// edge classes into `edges`, which is the size of `image`
+void doubleThreshold(ImageView<const float> image, ImageView<uint8_t> edges,
+    const CannyConfig& config, bool parallel);
+// weak pixels survive if a chain of weak pixels leads to a strong one
+void hysteresis(ImageView<uint8_t> edges, bool parallel);
+
+// The same float stages on a range of rows, for callers that split the rows
+// themselves, like the MPI executables. As in canny_int.h, each writes rows
+// [start_y, end_y) of its output with global row indices. Output row y reads
+// input rows y and on, or y-1 to y+1 for non-maximum suppression. Edge
+// classes come from classifyEdgeRows.
+
+// output is getOutputWidth/Height(image, kernel.size), `mode` picks the 2D or
+// the separable loops
+void gaussianFilterRows(ImageView<const float> image, ImageView<float> output,
+    const GaussianKernel& kernel, GaussianMode mode, int start_y, int end_y);
+// magnitudes are not clamped, direction holds a DirectionSector per pixel
+void computeGradientRows(ImageView<const float> image, ImageView<float> magnitude,
+    ImageView<uint8_t> direction, GradientOperator op, int start_y, int end_y);
+// the first and last rows of `image` are taken as the image border and copied
+// through, like its first and last columns
+void nonMaxSuppressionRows(ImageView<const float> image, ImageView<const uint8_t> direction,
+    ImageView<float> output, int start_y, int end_y);
+
+#endif
@@ -1,13 +1,39 @@
+#include <stdexcept>
+#include <string>
 #include <cuda_runtime.h>
-#include <math_constants.h>
-#include "canny.h"
+#include "canny_cuda.h"
+#include "canny_hysteresis.h"
+#include "../trace.h"
 
+// neighbour offsets per direction sector, copied from sector_offsets
+__constant__ int d_sector_offsets[4][2];
+
+// same comparisons as directionSector, the tangents are passed in from the host
+__device__ uint8_t directionSectorDevice(
+    float sum_x, float sum_y, float tan_low, float tan_high
+) {
+    float abs_x = fabsf(sum_x);
+    float abs_y = fabsf(sum_y);
+    if (abs_y <= tan_low * abs_x) {
+        return sector_0;
+    }
+    if (abs_y >= tan_high * abs_x) {
+        return sector_90;
+    }
+    return ((sum_x < 0) == (sum_y < 0)) ? sector_45 : sector_135;
+}
+
+// The Gaussian kernels are specialized for a size, or 0 for any size, which
+// is then read from kernel_size, see dispatchGaussianSize
+template <int Size>
 __global__ void gaussianFilterKernel(
-    float* d_image, float* d_new_image, int width, int height, float* d_kernel
+    float* d_image, float* d_new_image, int width, int height, float* d_kernel,
+    int kernel_size
 ) {
     int x = blockIdx.x * blockDim.x + threadIdx.x;
     int y = blockIdx.y * blockDim.y + threadIdx.y;
-    int kernel_radius = gaussian_kernel_size / 2;
+    const int size = Size > 0 ? Size : kernel_size;
+    int kernel_radius = size / 2;
     int x_bound = width - kernel_radius;
     int y_bound = height - kernel_radius;
 
@@ -19,8 +45,7 @@ __global__ void gaussianFilterKernel(
     for (int i = -kernel_radius; i <= kernel_radius; i++) {
         for (int j = -kernel_radius; j <= kernel_radius; j++) {
             int img_idx = (y + i) * width + (x + j);
-            int kernel_idx =
-                (i + kernel_radius) * gaussian_kernel_size + (j + kernel_radius);
+            int kernel_idx = (i + kernel_radius) * size + (j + kernel_radius);
             magnitude += d_image[img_idx] * d_kernel[kernel_idx];
         }
     }
@@ -30,13 +55,57 @@ __global__ void gaussianFilterKernel(
     d_new_image[new_image_idx] = magnitude;
 }
 
+// horizontal 1D pass over every row, output is narrower by the kernel radius twice
+template <int Size>
+__global__ void gaussianRowKernel(
+    float* d_image, float* d_new_image, int width, int height, float* d_kernel,
+    int kernel_size
+) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    const int size = Size > 0 ? Size : kernel_size;
+    int new_width = width - size + 1;
+
+    if (x >= new_width || y >= height) {
+        return;
+    }
+
+    float magnitude = 0.0f;
+    for (int j = 0; j < size; ++j) {
+        magnitude += d_image[y * width + x + j] * d_kernel[j];
+    }
+    d_new_image[y * new_width + x] = magnitude;
+}
+
+// vertical 1D pass over the output of gaussianRowKernel
+template <int Size>
+__global__ void gaussianColumnKernel(
+    float* d_image, float* d_new_image, int width, int height, float* d_kernel,
+    int kernel_size
+) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    const int size = Size > 0 ? Size : kernel_size;
+    int new_height = height - size + 1;
+
+    if (x >= width || y >= new_height) {
+        return;
+    }
+
+    float magnitude = 0.0f;
+    for (int i = 0; i < size; ++i) {
+        magnitude += d_image[(y + i) * width + x] * d_kernel[i];
+    }
+    d_new_image[y * width + x] = magnitude;
+}
+
 __global__ void computeGradientKernel(
-    float* d_image, float* d_new_image, float* d_direction, int width, int height,
-    int* d_sobel_x, int* d_sobel_y
+    float* d_image, float* d_new_image, uint8_t* d_direction, int width, int height,
+    int* d_gradient_x, int* d_gradient_y, float tan_low, float tan_high
 ) {
     int x = blockIdx.x * blockDim.x + threadIdx.x;
     int y = blockIdx.y * blockDim.y + threadIdx.y;
-    int kernel_radius = sobel_kernel_size / 2;
+    int kernel_radius = gradient_kernel_size / 2;
     int x_bound = width - kernel_radius;
     int y_bound = height - kernel_radius;
 
@@ -50,20 +119,21 @@ __global__ void computeGradientKernel(
         for (int j = -kernel_radius; j <= kernel_radius; ++j) {
             int img_idx = (y + i) * width + (x + j);
             int kernel_idx =
-                (i + kernel_radius) * sobel_kernel_size + (j + kernel_radius);
-            sum_x += d_image[img_idx] * d_sobel_x[kernel_idx];
-            sum_y += d_image[img_idx] * d_sobel_y[kernel_idx];
+                (i + kernel_radius) * gradient_kernel_size + (j + kernel_radius);
+            sum_x += d_image[img_idx] * d_gradient_x[kernel_idx];
+            sum_y += d_image[img_idx] * d_gradient_y[kernel_idx];
         }
     }
 
     int new_image_idx =
         (y - kernel_radius) * (width - kernel_radius*2) + (x - kernel_radius);
     d_new_image[new_image_idx] = sqrtf(sum_x * sum_x + sum_y * sum_y);
-    d_direction[new_image_idx] = atan2f(sum_y, sum_x) * 180.0f / CUDART_PI;
+    d_direction[new_image_idx] =
+        directionSectorDevice(sum_x, sum_y, tan_low, tan_high);
 }
 
 __global__ void nonMaxSuppression(
-    float* d_image, float* d_direction, float* d_new_image, int width, int height
+    float* d_image, uint8_t* d_direction, float* d_new_image, int width, int height
 ) {
     int x = blockIdx.x * blockDim.x + threadIdx.x;
     int y = blockIdx.y * blockDim.y + threadIdx.y;
@@ -72,32 +142,12 @@ __global__ void nonMaxSuppression(
         return;
     }
 
-    float direction = d_direction[y*width+x];
+    uint8_t sector = d_direction[y*width+x];
+    int dy = d_sector_offsets[sector][0];
+    int dx = d_sector_offsets[sector][1];
     float magnitude = d_image[y*width+x];
-    float first_pixel = 0.0f;
-    float second_pixel = 0.0f;
-
-    if ((direction >= -22.5f && direction < 22.5f) || 
-        (direction >= 157.5f / 8 && direction < -157.5f)) {
-        // fall in 0 degree direction area
-        first_pixel = d_image[y*width+x-1];
-        second_pixel = d_image[y*width+x+1];
-    } else if ((direction >= 22.5f && direction < 67.5f) ||
-               (direction >= -157.5f && direction < -112.5f)) {
-        // fall in 45 degree direction area
-        first_pixel = d_image[(y-1)*width+x-1];
-        second_pixel = d_image[(y+1)*width+x+1];
-    } else if ((direction >= 67.5f && direction < 112.5f) ||
-               (direction >= -112.5f && direction < -67.5f)) {
-        // fall in 90 degree direction area
-        first_pixel = d_image[(y-1)*width+x];
-        second_pixel = d_image[(y+1)*width+x];
-    } else if ((direction >= 112.5f && direction < 157.5f) ||
-               (direction >= -67.5f && direction < -22.5f)) {
-        // fall in 135 degree direction area
-        first_pixel = d_image[(y-1)*width+x+1];
-        second_pixel = d_image[(y+1)*width+x-1];
-    }
+    float first_pixel = d_image[(y+dy)*width+x+dx];
+    float second_pixel = d_image[(y-dy)*width+x-dx];
 
     if (magnitude >= first_pixel && magnitude >= second_pixel) {
         d_new_image[y*width+x] = magnitude;
@@ -107,7 +157,7 @@ __global__ void nonMaxSuppression(
 }
 
 __global__ void doubleThresholdKernel(
-    float* d_image, float* d_new_image, int width, int height,
+    float* d_image, uint8_t* d_edges, int width, int height,
     float low_threshold, float high_threshold
 ) {
     int x = blockIdx.x * blockDim.x + threadIdx.x;
@@ -119,99 +169,159 @@ __global__ void doubleThresholdKernel(
 
     int idx = y * width + x;
     float magnitude = d_image[idx];
-
     if (magnitude >= high_threshold) {
-        d_new_image[idx] = 255.0f;
+        d_edges[idx] = edge_strong;
     } else if (magnitude >= low_threshold) {
-        bool found_strong = false;
-        for (int dy = -1; dy <= 1; ++dy) {
-            for (int dx = -1; dx <= 1; ++dx) {
-                if (y + dy < 0 || y + dy >= height ||
-                    x + dx < 0 || x + dx >= width) {
-                    continue;
-                }
-                int img_idx = (y + dy) * width + x + dx;
-                if (d_image[img_idx] >= high_threshold) {
-                    found_strong = true;
-                    break;
-                }
-            }
-            if (found_strong) { break; }
-        }
-
-        if (found_strong) {
-            d_new_image[idx] = 255.0f;
-        } else {
-            d_new_image[idx] = 0.0f;
-        }
+        d_edges[idx] = edge_weak;
     } else {
-        d_new_image[idx] = 0.0f;
+        d_edges[idx] = edge_none;
     }
 }
 
-void cannyCUDA(GrayImage* image) {
-    int width = image->width;
-    int height = image->height;
-    int size = width * height;
-    float* linear_image = new float[size];
-    for (int i = 0; i < height; ++i) {
-        float* dest_pos = linear_image + i * width;
-        memcpy(dest_pos, image->image[i], width * sizeof(float));
-        delete[] image->image[i];
+// One hysteresis step: weak pixels next to a strong one become strong. Pixels
+// are updated in place, so a step can already travel further than one pixel,
+// and the host repeats it until no pixel changes
+__global__ void hysteresisKernel(uint8_t* d_edges, int width, int height, int* d_changed) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+
+    if (x >= width || y >= height || d_edges[y * width + x] != edge_weak) {
+        return;
     }
-    delete[] image->image;
-
-    // generate gaussian kernel
-    float sum = 0.0f;
-    int linear_gaussian_size = gaussian_kernel_size * gaussian_kernel_size;
-    int gaussian_kernel_radius = gaussian_kernel_size / 2;
-    float* gaussian_kernel = new float[linear_gaussian_size];
-    for (int y = -gaussian_kernel_radius; y <= gaussian_kernel_radius; ++y) {
-        int y_idx = y + gaussian_kernel_radius;
-        for (int x = -gaussian_kernel_radius; x <= gaussian_kernel_radius; ++x) {
-            int x_idx = x + gaussian_kernel_radius;
-            float temp = exp(-(x * x + y * y) / (2 * gaussian_sd * gaussian_sd)) / 
-                (2 * M_PI * gaussian_sd * gaussian_sd);
-            sum += temp;
-            gaussian_kernel[y_idx * gaussian_kernel_size + x_idx] = temp;
+
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            if (y + dy < 0 || y + dy >= height ||
+                x + dx < 0 || x + dx >= width) {
+                continue;
+            }
+            if (d_edges[(y + dy) * width + x + dx] == edge_strong) {
+                d_edges[y * width + x] = edge_strong;
+                *d_changed = 1;
+                return;
+            }
         }
     }
-    // normalize gaussian kernel
-    for (int i = 0; i < linear_gaussian_size; ++i) {
-        gaussian_kernel[i] /= sum;
+}
+
+// whatever is still weak never reached a strong pixel
+__global__ void dropWeakEdgesKernel(uint8_t* d_edges, int width, int height) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+
+    if (x >= width || y >= height) {
+        return;
+    }
+
+    if (d_edges[y * width + x] == edge_weak) {
+        d_edges[y * width + x] = edge_none;
     }
+}
+
+namespace {
 
-    int linear_sobel_size = sobel_kernel_size * sobel_kernel_size;
-    int* linear_sobel_x = new int[linear_sobel_size];
-    int* linear_sobel_y = new int[linear_sobel_size];
-    for (int y = 0; y < sobel_kernel_size; ++y) {
-        int* dest_pos_x = linear_sobel_x + y * sobel_kernel_size;
-        int* dest_pos_y = linear_sobel_y + y * sobel_kernel_size;
-        memcpy(dest_pos_x, sobel_x[y], sobel_kernel_size * sizeof(int));
-        memcpy(dest_pos_y, sobel_y[y], sobel_kernel_size * sizeof(int));
+// throws on any failed CUDA call, so a missing GPU or a faulting kernel
+// surfaces as an error instead of garbage or a hang
+void checkCUDA(cudaError_t err, const char* what) {
+    if (err != cudaSuccess) {
+        throw std::runtime_error(std::string(what) + ": " + cudaGetErrorString(err));
     }
+}
 
-    float* d_image = nullptr;
-    float* d_new_image = nullptr;
-    float* d_direction = nullptr;
-    int* d_sobel_x = nullptr;
-    int* d_sobel_y = nullptr;
-    float* d_gaussian_kernel = nullptr;
-
-    cudaMalloc(&d_image, size*sizeof(float));
-    cudaMalloc(&d_new_image, size*sizeof(float));
-    cudaMalloc(&d_direction, size*sizeof(float));
-    cudaMalloc(&d_sobel_x, linear_sobel_size*sizeof(int));
-    cudaMalloc(&d_sobel_y, linear_sobel_size*sizeof(int));
-    cudaMalloc(&d_gaussian_kernel, linear_gaussian_size*sizeof(float));
-    cudaMemcpy(d_image, linear_image, size*sizeof(float), cudaMemcpyHostToDevice);
-    cudaMemcpy(d_sobel_x, linear_sobel_x, 
-        linear_sobel_size*sizeof(int), cudaMemcpyHostToDevice);
-    cudaMemcpy(d_sobel_y, linear_sobel_y,
-        linear_sobel_size*sizeof(int), cudaMemcpyHostToDevice);
-    cudaMemcpy(d_gaussian_kernel, gaussian_kernel, 
-        linear_gaussian_size*sizeof(float), cudaMemcpyHostToDevice);
-    
+// launches are asynchronous: a bad launch shows in cudaGetLastError and a
+// kernel that faulted shows when synchronizing
+void checkKernels(const char* what) {
+    checkCUDA(cudaGetLastError(), what);
+    checkCUDA(cudaDeviceSynchronize(), what);
+}
+
+// device memory of one cannyCUDA call, freed however the call ends
+struct CannyDeviceBuffers {
+    float* image = nullptr;
+    float* new_image = nullptr;
+    uint8_t* direction = nullptr;
+    int* gradient_x = nullptr;
+    int* gradient_y = nullptr;
+    float* gaussian_kernel = nullptr;
+    int* changed = nullptr;
+
+    ~CannyDeviceBuffers() {
+        cudaFree(image);
+        cudaFree(new_image);
+        cudaFree(direction);
+        cudaFree(gradient_x);
+        cudaFree(gradient_y);
+        cudaFree(gaussian_kernel);
+        cudaFree(changed);
+    }
+};
+
+}
+
+void cannyCUDA(ImageView<const float> input, ImageView<uint8_t> output,
+    const CannyConfig& config
+) {
+    int width = input.width;
+    int height = input.height;
+    int size = width * height;
+
+    // the kernels are tiny, keep their host copies on the stack. The 2D
+    // Gaussian is packed to gaussian_size columns
+    GaussianKernel gaussian = makeGaussianKernel(config.gaussian_size, config.gaussian_sd);
+    int gaussian_size = gaussian.size;
+    float linear_gaussian[max_gaussian_kernel_size * max_gaussian_kernel_size];
+    int linear_gaussian_size = gaussian_size * gaussian_size;
+    if (config.gaussian == GaussianMode::Separable) {
+        linear_gaussian_size = gaussian_size;
+        memcpy(linear_gaussian, gaussian.weights_1d, gaussian_size * sizeof(float));
+    } else {
+        for (int y = 0; y < gaussian_size; ++y) {
+            memcpy(linear_gaussian + y * gaussian_size, gaussian.weights_2d[y],
+                gaussian_size * sizeof(float));
+        }
+    }
+    const GradientKernel gradient = makeGradientKernel(config.gradient);
+    const int linear_gradient_size = gradient_kernel_size * gradient_kernel_size;
+
+    CannyDeviceBuffers buffers;
+    checkCUDA(cudaMalloc(&buffers.image, size*sizeof(float)),
+        "Failed to allocate device memory for the image");
+    checkCUDA(cudaMalloc(&buffers.new_image, size*sizeof(float)),
+        "Failed to allocate device memory for the image");
+    checkCUDA(cudaMalloc(&buffers.direction, size*sizeof(uint8_t)),
+        "Failed to allocate device memory for the directions");
+    checkCUDA(cudaMalloc(&buffers.gradient_x, linear_gradient_size*sizeof(int)),
+        "Failed to allocate device memory for the kernels");
+    checkCUDA(cudaMalloc(&buffers.gradient_y, linear_gradient_size*sizeof(int)),
+        "Failed to allocate device memory for the kernels");
+    checkCUDA(cudaMalloc(&buffers.gaussian_kernel, linear_gaussian_size*sizeof(float)),
+        "Failed to allocate device memory for the kernels");
+    checkCUDA(cudaMalloc(&buffers.changed, sizeof(int)),
+        "Failed to allocate device memory for the hysteresis flag");
+    float* d_image = buffers.image;
+    float* d_new_image = buffers.new_image;
+    uint8_t* d_direction = buffers.direction;
+    int* d_gradient_x = buffers.gradient_x;
+    int* d_gradient_y = buffers.gradient_y;
+    float* d_gaussian_kernel = buffers.gaussian_kernel;
+    int* d_changed = buffers.changed;
+
+    // host rows are padded, device rows are packed
+    checkCUDA(cudaMemcpy2D(d_image, width*sizeof(float),
+        input.data, input.stride*sizeof(float),
+        width*sizeof(float), height, cudaMemcpyHostToDevice),
+        "Failed to copy data to device memory");
+    checkCUDA(cudaMemcpy(d_gradient_x, gradient.x,
+        linear_gradient_size*sizeof(int), cudaMemcpyHostToDevice),
+        "Failed to copy the kernels to device memory");
+    checkCUDA(cudaMemcpy(d_gradient_y, gradient.y,
+        linear_gradient_size*sizeof(int), cudaMemcpyHostToDevice),
+        "Failed to copy the kernels to device memory");
+    checkCUDA(cudaMemcpy(d_gaussian_kernel, linear_gaussian,
+        linear_gaussian_size*sizeof(float), cudaMemcpyHostToDevice),
+        "Failed to copy the kernels to device memory");
+    checkCUDA(cudaMemcpyToSymbol(d_sector_offsets, sector_offsets, sizeof(sector_offsets)),
+        "Failed to copy the kernels to device memory");
 
     int block_x = 16;
     int block_y = 16;
@@ -220,85 +330,85 @@ void cannyCUDA(GrayImage* image) {
     dim3 block(block_x, block_y);
     dim3 grid(grid_x, grid_y);
 
-    gaussianFilterKernel<<<grid, block>>>
-        (d_image, d_new_image, width, height, d_gaussian_kernel);
-    cudaDeviceSynchronize();
-    width = getOutputWidth(width, gaussian_kernel_size);
-    height = getOutputHeight(height, gaussian_kernel_size);
+    // every stage synchronizes, so its span covers the kernels and not just
+    // their launches
+    TRACE_SCOPE("cannyCUDA");
+    {
+        TRACE_SCOPE("gaussianFilter");
+        dispatchGaussianSize(gaussian_size, [&](auto fixed_size) {
+            constexpr int Size = decltype(fixed_size)::value;
+            if (config.gaussian == GaussianMode::Separable) {
+                // the column pass writes back into d_image, so no copy is needed after it
+                gaussianRowKernel<Size><<<grid, block>>>
+                    (d_image, d_new_image, width, height, d_gaussian_kernel, gaussian_size);
+                checkKernels("Gaussian filter failed");
+                gaussianColumnKernel<Size><<<grid, block>>>
+                    (d_new_image, d_image, getOutputWidth(width, gaussian_size),
+                    height, d_gaussian_kernel, gaussian_size);
+            } else {
+                gaussianFilterKernel<Size><<<grid, block>>>
+                    (d_image, d_new_image, width, height, d_gaussian_kernel, gaussian_size);
+            }
+            checkKernels("Gaussian filter failed");
+        });
+    }
+    width = getOutputWidth(width, gaussian_size);
+    height = getOutputHeight(height, gaussian_size);
     size = width * height;
-    cudaMemcpy(d_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToDevice);
+    if (config.gaussian == GaussianMode::Full2D) {
+        checkCUDA(cudaMemcpy(d_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToDevice),
+            "Failed to copy device memory");
+    }
 
-    computeGradientKernel<<<grid, block>>>
-        (d_image, d_new_image, d_direction, width, height, d_sobel_x, d_sobel_y);
-    cudaDeviceSynchronize();
-    width = getOutputWidth(width, sobel_kernel_size);
-    height = getOutputHeight(height, sobel_kernel_size);
+    {
+        TRACE_SCOPE("computeGradients");
+        computeGradientKernel<<<grid, block>>>
+            (d_image, d_new_image, d_direction, width, height, d_gradient_x, d_gradient_y,
+            tan_22_5, tan_67_5);
+        checkKernels("Gradient computation failed");
+    }
+    width = getOutputWidth(width, gradient_kernel_size);
+    height = getOutputHeight(height, gradient_kernel_size);
     size = width * height;
-    cudaMemcpy(d_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToDevice);
-
-    nonMaxSuppression<<<grid, block>>>
-        (d_image, d_direction, d_new_image, width, height);
-    cudaDeviceSynchronize();
-    cudaMemcpy(d_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToDevice);
-
-    doubleThresholdKernel<<<grid, block>>>
-        (d_image, d_new_image, width, height, low_threshold, high_threshold);
-    cudaDeviceSynchronize();
-    cudaMemcpy(linear_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToHost);
-
-    float** new_image_2d = new float*[height];
-    for (int y = 0; y < height; ++y) {
-        new_image_2d[y] = new float[width];
-        float* src_pos = linear_image + y * width;
-        memcpy(new_image_2d[y], src_pos, width * sizeof(float));
+    checkCUDA(cudaMemcpy(d_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToDevice),
+        "Failed to copy device memory");
+
+    {
+        TRACE_SCOPE("nonMaxSuppression");
+        nonMaxSuppression<<<grid, block>>>
+            (d_image, d_direction, d_new_image, width, height);
+        checkKernels("Non-maximum suppression failed");
     }
-
-    image->image = new_image_2d;
-    image->width = width;
-    image->height = height;
-
-    delete[] linear_image;
-    delete[] gaussian_kernel;
-    cudaFree(d_image);
-    cudaFree(d_new_image);
-    cudaFree(d_direction);
-    cudaFree(d_sobel_x);
-    cudaFree(d_sobel_y);
-    cudaFree(d_gaussian_kernel);
-}
-
-int main(int argc, char** argv) {
-    bool verbose = false;
-    if (argc > 1) {
-        auto arg1 = std::string(argv[1]);
-        if (arg1 == "-v" || arg1 == "--verbose") {
-            verbose = true;
-        }
+    checkCUDA(cudaMemcpy(d_image, d_new_image, size*sizeof(float), cudaMemcpyDeviceToDevice),
+        "Failed to copy device memory");
+
+    // directions are no longer needed, their buffer holds the edge classes
+    uint8_t* d_edges = d_direction;
+    {
+        TRACE_SCOPE("doubleThreshold");
+        doubleThresholdKernel<<<grid, block>>>
+            (d_image, d_edges, width, height, config.low_threshold, config.high_threshold);
+        checkKernels("Double threshold failed");
     }
 
-    std::cout << "==========CUDA Canny==========" << std::endl;
-    std::cout << "Loading images..." << std::endl;
-    std::vector<GrayImage*> images = getBSDS500Images(verbose);
-
-    std::cout << "Start processing images..." << std::endl;
-    auto start = chrono::high_resolution_clock::now();
-    for (auto& image : images) {
-        if (verbose) {
-            std::cout << "Processing image ["
-                << image->file_name << "]..." << std::endl;
-        }
-        cannyCUDA(image);
-
-        image->saveImage("../canny_outputs/cuda");
-        if (verbose) {
-            std::cout << "Saved output of image [" 
-                << image->file_name << "] successfully" << std::endl;
+    {
+        TRACE_SCOPE("hysteresis");
+        // any failed call throws, so the loop only goes on while the flag
+        // was really read back as set
+        int changed = 1;
+        while (changed) {
+            checkCUDA(cudaMemset(d_changed, 0, sizeof(int)), "Hysteresis failed");
+            hysteresisKernel<<<grid, block>>>(d_edges, width, height, d_changed);
+            checkCUDA(cudaGetLastError(), "Hysteresis failed");
+            checkCUDA(cudaMemcpy(&changed, d_changed, sizeof(int), cudaMemcpyDeviceToHost),
+                "Hysteresis failed");
         }
-        delete image;
+        dropWeakEdgesKernel<<<grid, block>>>(d_edges, width, height);
+        checkKernels("Hysteresis failed");
     }
-    auto end = chrono::high_resolution_clock::now();
-    auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
-    std::cout << "Duration: " << duration.count() << " ns" << std::endl;
 
-    return 0;
+    checkCUDA(cudaMemcpy2D(output.data, output.stride*sizeof(uint8_t),
+        d_edges, width*sizeof(uint8_t),
+        width*sizeof(uint8_t), height, cudaMemcpyDeviceToHost),
+        "Failed to copy data from device memory");
 }
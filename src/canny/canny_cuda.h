@@ -0,0 +1,11 @@
+#ifndef CANNY_CUDA_H
+#define CANNY_CUDA_H
+#include "canny.h"
+
+// Canny on the GPU. Always staged, config picks the Gaussian, the operator
+// and the thresholds. Edges are getFusedOutputWidth/Height of the input, like
+// cannyCPU. Throws std::runtime_error if any CUDA call fails, e.g. without a GPU
+void cannyCUDA(ImageView<const float> input, ImageView<uint8_t> output,
+    const CannyConfig& config);
+
+#endif
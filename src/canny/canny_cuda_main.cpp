@@ -0,0 +1,48 @@
+#include "canny.h"
+#include "../image_cache.h"
+#include "../pipeline.h"
+#include "../trace.h"
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    CannyConfig config = parseCannyArgs(argc, argv, &verbose);
+    PipelineConfig pipeline_config = parsePipelineArgs(argc, argv);
+    std::string cache_path = parseImageCacheArg(argc, argv);
+    std::string trace_path = parseTraceArg(argc, argv);
+
+    std::cout << "==========CUDA Canny==========" << std::endl;
+    std::cout << "Loading images..." << std::endl;
+    ImageCache cache;
+    std::vector<ImageSource> sources = listDatasetImages(cache_path, &cache, verbose);
+    EdgeParams params;
+    params.canny = config;
+    // there are no integer kernels on the GPU, images run through the float ones
+    params.canny.integer = false;
+
+    std::cout << "Start processing images..." << std::endl;
+    traceStart(0, "CUDA Canny");
+    auto start = chrono::high_resolution_clock::now();
+    ImagePipeline pipeline(sources, PixelFormat::Float32, "../canny_outputs/cuda",
+        pipeline_config, verbose);
+    while (GrayImage* image = pipeline.next()) {
+        if (verbose) {
+            std::cout << "Processing image ["
+                << image->file_name << "]..." << std::endl;
+        }
+        detectEdges(image, EdgeAlgorithm::Canny, EdgeBackend::CUDA, params);
+
+        pipeline.done(image);
+    }
+    pipeline.finish();
+    auto end = chrono::high_resolution_clock::now();
+    auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    std::cout << "Duration: " << duration.count() << " ns" << std::endl;
+    BufferPoolStats pool_stats = bufferPoolStats();
+    std::cout << "Image buffers: " << pool_stats.heap_allocations << " allocated, "
+        << pool_stats.reuses << " reused" << std::endl;
+    if (!trace_path.empty()) {
+        writeTrace(trace_path);
+    }
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include "canny_fused.h"
+#include "canny_hysteresis.h"
+
+namespace {
+
+// Rolling window over the rows of one stage. Row y lives in slot y % capacity
+// and rows are produced strictly in order, starting from `next`
+template <typename T>
+struct RowRing {
+    ImageBuffer<T> slots;
+    int next;
+
+    RowRing(int width, int capacity, int first): slots(width, capacity), next(first) {}
+
+    T* operator[](int y) const {
+        return slots[y % slots.height];
+    }
+};
+
+// Specialized for a Gaussian size, or 0 for any size, and a gradient operator
+template <int Size, GradientOperator Op>
+struct FusedCanny {
+    // rows [input_start_y, input_start_y + input.height) of the image
+    ImageView<const float> input;
+    int input_start_y;
+    const GaussianKernel& gaussian;
+    int gaussian_size;
+    float low_threshold, high_threshold;
+    int smooth_width, smooth_height;
+    int gradient_width, gradient_height;
+
+    RowRing<float> horizontal_rows;
+    RowRing<float> smoothed_rows;
+    // direction rows are produced together with magnitude rows
+    RowRing<float> magnitude_rows;
+    RowRing<uint8_t> direction_rows;
+    RowRing<float> suppressed_rows;
+
+    FusedCanny(ImageView<const float> input, int input_start_y, int image_height,
+        const GaussianKernel& gaussian, const CannyConfig& config, int start_y
+    ):
+        input(input),
+        input_start_y(input_start_y),
+        gaussian(gaussian),
+        gaussian_size(gaussianSize<Size>(gaussian)),
+        low_threshold(config.low_threshold),
+        high_threshold(config.high_threshold),
+        smooth_width(getOutputWidth(input.width, gaussian_size)),
+        smooth_height(getOutputHeight(image_height, gaussian_size)),
+        gradient_width(getOutputWidth(smooth_width, gradient_kernel_size)),
+        gradient_height(getOutputHeight(smooth_height, gradient_kernel_size)),
+        // suppressed row y reads gradient rows y-1..y+1, which read smoothed
+        // rows from y-1 on
+        horizontal_rows(smooth_width, gaussian_size, std::max(0, start_y - 1)),
+        smoothed_rows(smooth_width, gradient_kernel_size, std::max(0, start_y - 1)),
+        magnitude_rows(gradient_width, 3, std::max(0, start_y - 1)),
+        direction_rows(gradient_width, 3, std::max(0, start_y - 1)),
+        suppressed_rows(gradient_width, 1, start_y)
+    {}
+
+    void ensureHorizontal(int y) {
+        const auto& gaussian_kernel = gaussian.weights_1d;
+        const int size = gaussianSize<Size>(gaussian);
+        for (; horizontal_rows.next <= y; ++horizontal_rows.next) {
+            const float* input_row = input[horizontal_rows.next - input_start_y];
+            float* output_row = horizontal_rows[horizontal_rows.next];
+            for (int x = 0; x < smooth_width; ++x) {
+                float magnitude = 0.0f;
+                for (int j = 0; j < size; ++j) {
+                    magnitude += gaussian_kernel[j] * input_row[x+j];
+                }
+                output_row[x] = magnitude;
+            }
+        }
+    }
+
+    void ensureSmoothed(int y) {
+        const auto& gaussian_kernel = gaussian.weights_1d;
+        const int size = gaussianSize<Size>(gaussian);
+        for (; smoothed_rows.next <= y; ++smoothed_rows.next) {
+            int row = smoothed_rows.next;
+            ensureHorizontal(row + size - 1);
+
+            float* output_row = smoothed_rows[row];
+            for (int x = 0; x < smooth_width; ++x) {
+                output_row[x] = 0.0f;
+            }
+            for (int i = 0; i < size; ++i) {
+                const float* input_row = horizontal_rows[row + i];
+                for (int x = 0; x < smooth_width; ++x) {
+                    output_row[x] += gaussian_kernel[i] * input_row[x];
+                }
+            }
+        }
+    }
+
+    void ensureGradient(int y) {
+        constexpr GradientKernel kernel = makeGradientKernel(Op);
+        for (; magnitude_rows.next <= y; ++magnitude_rows.next) {
+            int row = magnitude_rows.next;
+            ensureSmoothed(row + gradient_kernel_size - 1);
+
+            float* magnitude_row = magnitude_rows[row];
+            uint8_t* direction_row = direction_rows[row];
+            for (int x = 0; x < gradient_width; ++x) {
+                float sum_x = 0.0f;
+                float sum_y = 0.0f;
+
+                for (int i = 0; i < 3; ++i) {
+                    const float* input_row = smoothed_rows[row + i];
+                    for (int j = 0; j < 3; ++j) {
+                        sum_x += kernel.x[i][j] * input_row[x+j];
+                        sum_y += kernel.y[i][j] * input_row[x+j];
+                    }
+                }
+
+                magnitude_row[x] = std::sqrt(sum_x * sum_x + sum_y * sum_y);
+                direction_row[x] = directionSector(sum_x, sum_y);
+            }
+        }
+    }
+
+    void ensureSuppressed(int y) {
+        int width = gradient_width;
+        for (; suppressed_rows.next <= y; ++suppressed_rows.next) {
+            int row = suppressed_rows.next;
+            float* output_row = suppressed_rows[row];
+
+            if (row == 0 || row == gradient_height - 1) {
+                // border rows are kept as is
+                ensureGradient(row);
+                memcpy(output_row, magnitude_rows[row], width * sizeof(float));
+                continue;
+            }
+
+            ensureGradient(row + 1);
+            const float* rows[3] = {
+                magnitude_rows[row - 1], magnitude_rows[row], magnitude_rows[row + 1]};
+            const uint8_t* direction_row = direction_rows[row];
+            output_row[0] = rows[1][0];
+            output_row[width-1] = rows[1][width-1];
+
+            for (int x = 1; x < width-1; ++x) {
+                // the sector picks the neighbours by table lookup instead of branching
+                int dy = sector_offsets[direction_row[x]][0];
+                int dx = sector_offsets[direction_row[x]][1];
+                float magnitude = rows[1][x];
+                float first_pixel = rows[1 + dy][x + dx];
+                float second_pixel = rows[1 - dy][x - dx];
+                bool keep = magnitude >= first_pixel && magnitude >= second_pixel;
+                output_row[x] = keep ? magnitude : 0.0f;
+            }
+        }
+    }
+
+    void classify(int y, uint8_t* output_row) {
+        ensureSuppressed(y);
+        const float* current = suppressed_rows[y];
+        for (int x = 0; x < gradient_width; ++x) {
+            output_row[x] = current[x] >= high_threshold ? edge_strong :
+                            current[x] >= low_threshold ? edge_weak : edge_none;
+        }
+    }
+};
+
+// runs rows [start_y, end_y) through the FusedCanny specialized for config
+template <typename Classify>
+void runFusedCanny(ImageView<const float> input, int input_start_y, int image_height,
+    const CannyConfig& config, int start_y, Classify classify
+) {
+    GaussianKernel gaussian = makeGaussianKernel(config.gaussian_size, config.gaussian_sd);
+    dispatchGaussianSize(config.gaussian_size, [&](auto size) {
+        dispatchGradientOperator(config.gradient, [&](auto op) {
+            FusedCanny<decltype(size)::value, decltype(op)::value> canny(
+                input, input_start_y, image_height, gaussian, config, start_y);
+            classify(canny);
+        });
+    });
+}
+
+}
+
+void cannyFusedRows(ImageView<const float> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, int start_y, int end_y
+) {
+    if (start_y >= end_y) { return; }
+
+    runFusedCanny(input, 0, input.height, config, start_y, [&](auto& canny) {
+        for (int y = start_y; y < end_y; ++y) {
+            canny.classify(y, edges[y]);
+        }
+    });
+}
+
+void cannyFusedBand(ImageView<const float> input, int input_start_y, int image_height,
+    ImageView<uint8_t> edges, const CannyConfig& config, int start_y, int end_y
+) {
+    if (start_y >= end_y) { return; }
+
+    runFusedCanny(input, input_start_y, image_height, config, start_y, [&](auto& canny) {
+        for (int y = start_y; y < end_y; ++y) {
+            canny.classify(y, edges[y - start_y]);
+        }
+    });
+}
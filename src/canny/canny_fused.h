@@ -0,0 +1,41 @@
+#ifndef CANNY_FUSED_H
+#define CANNY_FUSED_H
+#include "canny.h"
+
+inline int getFusedOutputHeight(int image_height, const CannyConfig& config) {
+    return getOutputHeight(getOutputHeight(image_height, config.gaussian_size),
+        gradient_kernel_size);
+}
+
+inline int getFusedOutputWidth(int image_width, const CannyConfig& config) {
+    return getOutputWidth(getOutputWidth(image_width, config.gaussian_size),
+        gradient_kernel_size);
+}
+
+// Streams rows of `input` through separable Gaussian -> gradients -> non-maximum
+// suppression -> double threshold and writes the edge classes of output rows
+// [start_y, end_y). Intermediate rows only live in small per-stage ring
+// buffers, so a call on a strip of the output recomputes the few halo rows
+// above it and can run independently of other strips. Hysteresis needs the
+// whole image and is left to the caller. Output matches the stage-by-stage
+// path with GaussianMode::Separable. config.gaussian and config.execution are
+// not read.
+void cannyFusedRows(ImageView<const float> input, ImageView<uint8_t> edges,
+    const CannyConfig& config, int start_y, int end_y);
+
+// output rows [start_y, end_y) read the input rows from fused_halo_above rows
+// above start_y to fusedHaloBelow rows below end_y, clipped to the image
+const int fused_halo_above = 1;
+
+inline int fusedHaloBelow(const CannyConfig& config) {
+    return config.gaussian_size + gradient_kernel_size - 1;
+}
+
+// The same for an image that is only partly in memory. `input` holds rows
+// [input_start_y, input_start_y + input.height) of an image image_height rows
+// tall, at least the rows the output rows read, and edge class row y is
+// written to edges[y - start_y]. Border rows are still those of the image.
+void cannyFusedBand(ImageView<const float> input, int input_start_y, int image_height,
+    ImageView<uint8_t> edges, const CannyConfig& config, int start_y, int end_y);
+
+#endif
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <vector>
+#include "canny_hysteresis.h"
+
+void classifyEdgeRows(ImageView<const float> magnitude, ImageView<uint8_t> edges,
+    const CannyConfig& config, int start_y, int end_y
+) {
+    const float low_threshold = config.low_threshold;
+    const float high_threshold = config.high_threshold;
+    int width = magnitude.width;
+    for (int y = start_y; y < end_y; ++y) {
+        const float* input_row = magnitude[y];
+        uint8_t* output_row = edges[y];
+        for (int x = 0; x < width; ++x) {
+            float value = input_row[x];
+            output_row[x] = value >= high_threshold ? edge_strong :
+                            value >= low_threshold ? edge_weak : edge_none;
+        }
+    }
+}
+
+int promoteWeakEdges(ImageView<uint8_t> edges, int count_start_y, int count_end_y) {
+    struct Point { int x, y; };
+    int width = edges.width;
+    int height = edges.height;
+    // kept per thread, so the stack only grows while it sees larger images
+    thread_local std::vector<Point> stack;
+    stack.clear();
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (edges[y][x] == edge_strong) {
+                stack.push_back({x, y});
+            }
+        }
+    }
+
+    // weak pixels are promoted when pushed, so none is visited twice
+    int promoted = 0;
+    while (!stack.empty()) {
+        Point point = stack.back();
+        stack.pop_back();
+        int first_row = std::max(0, point.y - 1);
+        int last_row = std::min(height - 1, point.y + 1);
+        int first_col = std::max(0, point.x - 1);
+        int last_col = std::min(width - 1, point.x + 1);
+        for (int y = first_row; y <= last_row; ++y) {
+            for (int x = first_col; x <= last_col; ++x) {
+                if (edges[y][x] == edge_weak) {
+                    edges[y][x] = edge_strong;
+                    stack.push_back({x, y});
+                    promoted += (y >= count_start_y && y < count_end_y);
+                }
+            }
+        }
+    }
+    return promoted;
+}
+
+void dropWeakEdges(ImageView<uint8_t> edges) {
+    // whatever is still weak never reached a strong pixel
+    for (int y = 0; y < edges.height; ++y) {
+        for (int x = 0; x < edges.width; ++x) {
+            if (edges[y][x] == edge_weak) {
+                edges[y][x] = edge_none;
+            }
+        }
+    }
+}
+
+void hysteresisFloodFill(ImageView<uint8_t> edges) {
+    promoteWeakEdges(edges, 0, 0);
+    dropWeakEdges(edges);
+}
+
+namespace {
+
+// Labels are linear pixel indices and every root is the smallest index of its
+// component. strong[root] tells whether the component holds a strong pixel.
+// Entries are only written for edge pixels, by the strip that owns them, so the
+// buffers are left uninitialised instead of being cleared by one thread
+struct EdgeLabels {
+    ImageBuffer<int> parent_buffer;
+    ImageBuffer<uint8_t> strong_buffer;
+    int* parent;
+    uint8_t* strong;
+
+    EdgeLabels(int width, int height):
+        parent_buffer(width, height), strong_buffer(width, height),
+        parent(parent_buffer.data), strong(strong_buffer.data) {}
+
+    // path halving, only called where no other thread touches the same tree
+    int find(int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    // read-only lookup, safe to run from every thread at once
+    int findRoot(int i) const {
+        while (parent[i] != i) {
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) { return; }
+        if (b < a) { std::swap(a, b); }
+        parent[b] = a;
+        strong[a] |= strong[b];
+    }
+};
+
+// labels rows [start_y, end_y) looking only at neighbours inside the strip
+void labelStrip(ImageView<const uint8_t> edges, EdgeLabels* labels,
+    int start_y, int end_y
+) {
+    int width = edges.width;
+    for (int y = start_y; y < end_y; ++y) {
+        const uint8_t* row = edges[y];
+        const uint8_t* above = y > start_y ? edges[y - 1] : nullptr;
+        for (int x = 0; x < width; ++x) {
+            if (row[x] == edge_none) { continue; }
+
+            int i = y * width + x;
+            labels->parent[i] = i;
+            labels->strong[i] = row[x] == edge_strong;
+
+            // west and the three pixels above are the already labelled neighbours
+            if (x > 0 && row[x-1] != edge_none) {
+                labels->unite(i, i - 1);
+            }
+            if (!above) { continue; }
+            int first_col = std::max(0, x - 1);
+            int last_col = std::min(width - 1, x + 1);
+            for (int col = first_col; col <= last_col; ++col) {
+                if (above[col] != edge_none) {
+                    labels->unite(i, i - width + col - x);
+                }
+            }
+        }
+    }
+}
+
+}
+
+void hysteresisUnionFind(ImageView<uint8_t> edges, int tiles) {
+    int width = edges.width;
+    int height = edges.height;
+    tiles = std::max(1, std::min(tiles, height));
+    EdgeLabels labels(width, height);
+
+    int tile_start[tiles + 1];
+    for (int i = 0; i <= tiles; ++i) {
+        tile_start[i] = (int)((long)height * i / tiles);
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < tiles; ++i) {
+        labelStrip(edges, &labels, tile_start[i], tile_start[i + 1]);
+    }
+
+    // join the components that touch across each strip border. This is only
+    // width * tiles unions, so it stays serial
+    for (int i = 1; i < tiles; ++i) {
+        int y = tile_start[i];
+        const uint8_t* row = edges[y];
+        const uint8_t* above = edges[y - 1];
+        for (int x = 0; x < width; ++x) {
+            if (row[x] == edge_none) { continue; }
+            int first_col = std::max(0, x - 1);
+            int last_col = std::min(width - 1, x + 1);
+            for (int col = first_col; col <= last_col; ++col) {
+                if (above[col] != edge_none) {
+                    labels.unite(y * width + x, (y - 1) * width + col);
+                }
+            }
+        }
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < tiles; ++i) {
+        for (int y = tile_start[i]; y < tile_start[i + 1]; ++y) {
+            uint8_t* row = edges[y];
+            for (int x = 0; x < width; ++x) {
+                if (row[x] != edge_weak) { continue; }
+                bool strong = labels.strong[labels.findRoot(y * width + x)];
+                row[x] = strong ? edge_strong : edge_none;
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef CANNY_HYSTERESIS_H
+#define CANNY_HYSTERESIS_H
+#include "canny.h"
+
+// Edge classes written by the double threshold. Hysteresis then turns every
+// weak pixel that is 8-connected to a strong one, through any chain of weak
+// pixels, into a strong pixel and drops the rest, so the final map only holds
+// edge_none and edge_strong, which are also the grey levels that get saved.
+const uint8_t edge_none = 0;
+const uint8_t edge_weak = 1;
+const uint8_t edge_strong = 255;
+
+// writes the edge class of rows [start_y, end_y) of a suppressed magnitude,
+// using the thresholds of config
+void classifyEdgeRows(ImageView<const float> magnitude, ImageView<uint8_t> edges,
+    const CannyConfig& config, int start_y, int end_y);
+
+// Flood fill from every strong pixel with an explicit stack. Each pixel is
+// pushed at most once, so this is linear in the number of pixels.
+void hysteresisFloodFill(ImageView<uint8_t> edges);
+
+// The two halves of hysteresisFloodFill, for callers that only hold part of
+// the image: promoteWeakEdges turns weak pixels reachable from a strong one
+// into strong pixels and returns how many it promoted in rows
+// [count_start_y, count_end_y), dropWeakEdges clears whatever is left weak
+int promoteWeakEdges(ImageView<uint8_t> edges, int count_start_y, int count_end_y);
+void dropWeakEdges(ImageView<uint8_t> edges);
+
+// Two-pass union-find over `tiles` horizontal strips. Strips are labelled
+// independently (in parallel when built with OpenMP), the labels that touch
+// across a strip border are merged afterwards, and every weak pixel finally
+// looks up whether its component holds a strong pixel. The result is
+// identical to hysteresisFloodFill for any number of strips.
+void hysteresisUnionFind(ImageView<uint8_t> edges, int tiles);
+
+#endif
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include "canny_hysteresis.h"
+#include "canny_int.h"
+
+namespace {
+
+// Specialized for a Gaussian size, or 0 for any size, see dispatchGaussianSize
+template <int Size>
+void gaussianIntegerRowsWith(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    const GaussianFixedKernel& kernel, int start_y, int end_y
+) {
+    const auto& weights = kernel.weights;
+    const int size = Size > 0 ? Size : kernel.size;
+    const int shift = 2 * gaussian_fixed_bits;
+    int width = output.width;
+
+    // horizontal pass at full precision: 255 * 2^8 still fits in uint16
+    int horizontal_height = end_y - start_y + size - 1;
+    ImageBuffer<uint16_t> horizontal(width, horizontal_height);
+    for (int y = 0; y < horizontal_height; ++y) {
+        const uint8_t* input_row = input[start_y + y];
+        uint16_t* output_row = horizontal[y];
+        for (int x = 0; x < width; ++x) {
+            int sum = 0;
+            for (int j = 0; j < size; ++j) {
+                sum += weights[j] * input_row[x+j];
+            }
+            output_row[x] = (uint16_t)sum;
+        }
+    }
+
+    // vertical pass in int32, rounded once at the end
+    ImageBuffer<int32_t> sums(width, 1);
+    int32_t* sum_row = sums[0];
+    for (int y = start_y; y < end_y; ++y) {
+        for (int x = 0; x < width; ++x) {
+            sum_row[x] = 1 << (shift - 1);
+        }
+        for (int i = 0; i < size; ++i) {
+            const uint16_t* input_row = horizontal[y - start_y + i];
+            for (int x = 0; x < width; ++x) {
+                sum_row[x] += weights[i] * input_row[x];
+            }
+        }
+
+        uint8_t* output_row = output[y];
+        for (int x = 0; x < width; ++x) {
+            output_row[x] = (uint8_t)(sum_row[x] >> shift);
+        }
+    }
+}
+
+// the x kernel is side, centre, side on the right column minus the same on
+// the left one, so each derivative takes three differences
+template <GradientOperator Op>
+void gradientIntegerRowsWith(ImageView<const uint8_t> input, ImageView<int32_t> magnitude,
+    ImageView<uint8_t> direction, int start_y, int end_y
+) {
+    constexpr GradientKernel kernel = makeGradientKernel(Op);
+    constexpr int side = kernel.x[0][2];
+    constexpr int centre = kernel.x[1][2];
+    int width = magnitude.width;
+    for (int y = start_y; y < end_y; ++y) {
+        const uint8_t* row0 = input[y];
+        const uint8_t* row1 = input[y+1];
+        const uint8_t* row2 = input[y+2];
+        int32_t* magnitude_row = magnitude[y];
+        uint8_t* direction_row = direction[y];
+
+        for (int x = 0; x < width; ++x) {
+            int16_t sum_x = side * ((row0[x+2] - row0[x]) + (row2[x+2] - row2[x])) +
+                centre * (row1[x+2] - row1[x]);
+            int16_t sum_y = side * ((row2[x] + row2[x+2]) - (row0[x] + row0[x+2])) +
+                centre * (row2[x+1] - row0[x+1]);
+
+            magnitude_row[x] = (int32_t)sum_x * sum_x + (int32_t)sum_y * sum_y;
+            direction_row[x] = directionSector(sum_x, sum_y);
+        }
+    }
+}
+
+}
+
+void gaussianIntegerRows(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    const GaussianFixedKernel& kernel, int start_y, int end_y
+) {
+    if (start_y >= end_y) { return; }
+
+    dispatchGaussianSize(kernel.size, [&](auto size) {
+        gaussianIntegerRowsWith<decltype(size)::value>(input, output, kernel, start_y, end_y);
+    });
+}
+
+void gradientIntegerRows(ImageView<const uint8_t> input, ImageView<int32_t> magnitude,
+    ImageView<uint8_t> direction, GradientOperator op, int start_y, int end_y
+) {
+    dispatchGradientOperator(op, [&](auto constant) {
+        gradientIntegerRowsWith<decltype(constant)::value>(input, magnitude, direction,
+            start_y, end_y);
+    });
+}
+
+void nonMaxSuppressionIntegerRows(ImageView<const int32_t> magnitude,
+    ImageView<const uint8_t> direction, ImageView<int32_t> output,
+    int start_y, int end_y
+) {
+    int height = magnitude.height;
+    int width = magnitude.width;
+    for (int y = start_y; y < end_y; ++y) {
+        int32_t* output_row = output[y];
+        if (y == 0 || y == height - 1) {
+            memcpy(output_row, magnitude[y], width * sizeof(int32_t));
+            continue;
+        }
+
+        const int32_t* rows[3] = {magnitude[y-1], magnitude[y], magnitude[y+1]};
+        const uint8_t* direction_row = direction[y];
+        output_row[0] = rows[1][0];
+        output_row[width-1] = rows[1][width-1];
+
+        // the sector picks the neighbours by table lookup instead of branching
+        for (int x = 1; x < width-1; ++x) {
+            int dy = sector_offsets[direction_row[x]][0];
+            int dx = sector_offsets[direction_row[x]][1];
+            int32_t first_pixel = rows[1 + dy][x + dx];
+            int32_t second_pixel = rows[1 - dy][x - dx];
+            int32_t value = rows[1][x];
+            bool keep = value >= first_pixel && value >= second_pixel;
+            output_row[x] = keep ? value : 0;
+        }
+    }
+}
+
+void doubleThresholdIntegerRows(ImageView<const int32_t> magnitude,
+    ImageView<uint8_t> edges, const CannyConfig& config, int start_y, int end_y
+) {
+    const int32_t low = squaredThreshold(config.low_threshold);
+    const int32_t high = squaredThreshold(config.high_threshold);
+    int width = magnitude.width;
+
+    for (int y = start_y; y < end_y; ++y) {
+        const int32_t* current = magnitude[y];
+        uint8_t* output_row = edges[y];
+        for (int x = 0; x < width; ++x) {
+            output_row[x] = current[x] >= high ? edge_strong :
+                            current[x] >= low ? edge_weak : edge_none;
+        }
+    }
+}
+
+void cannyIntegerReference(ImageView<const uint8_t> input, ImageBuffer<uint8_t>* output,
+    const CannyConfig& config
+) {
+    GaussianFixedKernel gaussian = makeGaussianFixedKernel(config);
+    const auto& weights = gaussian.weights;
+    const int size = gaussian.size;
+    const int shift = 2 * gaussian_fixed_bits;
+    const GradientKernel gradient = makeGradientKernel(config.gradient);
+
+    int smooth_width = getOutputWidth(input.width, size);
+    int smooth_height = getOutputHeight(input.height, size);
+    ImageBuffer<uint8_t> smoothed(smooth_width, smooth_height);
+    for (int y = 0; y < smooth_height; ++y) {
+        for (int x = 0; x < smooth_width; ++x) {
+            int sum = 1 << (shift - 1);
+            for (int i = 0; i < size; ++i) {
+                for (int j = 0; j < size; ++j) {
+                    sum += weights[i] * weights[j] * input[y+i][x+j];
+                }
+            }
+            smoothed[y][x] = (uint8_t)(sum >> shift);
+        }
+    }
+
+    int width = getOutputWidth(smooth_width, gradient_kernel_size);
+    int height = getOutputHeight(smooth_height, gradient_kernel_size);
+    ImageBuffer<int32_t> magnitude(width, height);
+    ImageBuffer<uint8_t> direction(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int sum_x = 0;
+            int sum_y = 0;
+            for (int i = 0; i < 3; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    sum_x += gradient.x[i][j] * smoothed[y+i][x+j];
+                    sum_y += gradient.y[i][j] * smoothed[y+i][x+j];
+                }
+            }
+            magnitude[y][x] = sum_x * sum_x + sum_y * sum_y;
+            direction[y][x] = directionSector(sum_x, sum_y);
+        }
+    }
+
+    ImageBuffer<int32_t> suppressed(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int32_t value = magnitude[y][x];
+            if (y == 0 || y == height - 1 || x == 0 || x == width - 1) {
+                suppressed[y][x] = value;
+                continue;
+            }
+
+            int32_t first_pixel = 0;
+            int32_t second_pixel = 0;
+            if (direction[y][x] == sector_0) {
+                first_pixel = magnitude[y][x-1];
+                second_pixel = magnitude[y][x+1];
+            } else if (direction[y][x] == sector_45) {
+                first_pixel = magnitude[y-1][x-1];
+                second_pixel = magnitude[y+1][x+1];
+            } else if (direction[y][x] == sector_90) {
+                first_pixel = magnitude[y-1][x];
+                second_pixel = magnitude[y+1][x];
+            } else {
+                first_pixel = magnitude[y-1][x+1];
+                second_pixel = magnitude[y+1][x-1];
+            }
+            suppressed[y][x] = (value >= first_pixel && value >= second_pixel) ? value : 0;
+        }
+    }
+
+    const int32_t low = squaredThreshold(config.low_threshold);
+    const int32_t high = squaredThreshold(config.high_threshold);
+    *output = ImageBuffer<uint8_t>(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int32_t value = suppressed[y][x];
+            (*output)[y][x] = value >= high ? edge_strong :
+                              value >= low ? edge_weak : edge_none;
+        }
+    }
+
+    // grow the strong pixels one ring at a time until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                if ((*output)[y][x] != edge_weak) { continue; }
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        if (y + dy < 0 || y + dy >= height ||
+                            x + dx < 0 || x + dx >= width) {
+                            continue;
+                        }
+                        if ((*output)[y + dy][x + dx] == edge_strong) {
+                            (*output)[y][x] = edge_strong;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if ((*output)[y][x] == edge_weak) {
+                (*output)[y][x] = edge_none;
+            }
+        }
+    }
+}
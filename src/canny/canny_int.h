@@ -0,0 +1,77 @@
+#ifndef CANNY_INT_H
+#define CANNY_INT_H
+#include "canny.h"
+
+// Integer Canny: uint8 pixels in and out, int16 gradients and int32 squared
+// magnitudes in between. Gradient magnitudes are never square-rooted: the
+// thresholds are squared instead, which keeps every compare exact.
+//
+// Each stage writes rows [start_y, end_y) of its output, using global row
+// indices on full-size views, so the backends can split rows any way they like
+// and still get the same bits as cannyIntegerReference.
+//
+// Results are not bit-exact with the float path. The Gaussian rounds to whole
+// grey levels, and the direction sectors compare against tan(22.5) and
+// tan(67.5) in fixed point rather than in float.
+
+const int gaussian_fixed_bits = 8;
+
+struct GaussianFixedKernel {
+    int size;
+    int weights[max_gaussian_kernel_size];
+};
+
+// weights_1d in fixed point. The centre weight absorbs the rounding so the
+// weights always sum to exactly 2^gaussian_fixed_bits
+constexpr GaussianFixedKernel makeGaussianFixedKernel(const GaussianKernel& gaussian) {
+    GaussianFixedKernel kernel{};
+    kernel.size = gaussian.size;
+    int radius = gaussian.size / 2;
+    int sum = 0;
+    for (int i = 0; i < gaussian.size; ++i) {
+        if (i == radius) { continue; }
+        kernel.weights[i] =
+            (int)(gaussian.weights_1d[i] * (1 << gaussian_fixed_bits) + 0.5f);
+        sum += kernel.weights[i];
+    }
+    kernel.weights[radius] = (1 << gaussian_fixed_bits) - sum;
+    return kernel;
+}
+
+inline GaussianFixedKernel makeGaussianFixedKernel(const CannyConfig& config) {
+    return makeGaussianFixedKernel(makeGaussianKernel(config.gaussian_size, config.gaussian_sd));
+}
+
+// smallest squared integer magnitude that passes a float threshold, which
+// cannyConfigError keeps within [0, max_gradient_magnitude]
+inline int32_t squaredThreshold(float threshold) {
+    return (int32_t)std::ceil((double)threshold * threshold);
+}
+
+// output is getOutputWidth/Height(input, kernel.size)
+void gaussianIntegerRows(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    const GaussianFixedKernel& kernel, int start_y, int end_y);
+
+// magnitude holds gx^2 + gy^2, direction holds a DirectionSector per pixel.
+// Scharr gradients reach 16 * 255, which still fits the int16 sums
+void gradientIntegerRows(ImageView<const uint8_t> input, ImageView<int32_t> magnitude,
+    ImageView<uint8_t> direction, GradientOperator op, int start_y, int end_y);
+
+// first and last rows and columns are copied through, like the float path
+void nonMaxSuppressionIntegerRows(ImageView<const int32_t> magnitude,
+    ImageView<const uint8_t> direction, ImageView<int32_t> output,
+    int start_y, int end_y);
+
+// writes edge_none / edge_weak / edge_strong, hysteresis resolves the weak ones
+void doubleThresholdIntegerRows(ImageView<const int32_t> magnitude,
+    ImageView<uint8_t> edges, const CannyConfig& config, int start_y, int end_y);
+
+// Plain 2D loops over the same arithmetic, kept as the reference the stages
+// above are checked against. The 2D Gaussian uses the outer product of the
+// fixed-point weights and rounds once, which is what the separable passes
+// compute too, since the horizontal pass keeps its full precision. Hysteresis
+// grows the strong pixels one neighbourhood at a time until nothing changes.
+void cannyIntegerReference(ImageView<const uint8_t> input, ImageBuffer<uint8_t>* output,
+    const CannyConfig& config);
+
+#endif
@@ -1,375 +1,540 @@
 #include <mpi.h>
-#include "canny.h"
+#include "canny_cpu.h"
+#include "canny_fused.h"
+#include "canny_hysteresis.h"
+#include "canny_int.h"
+#include "../image_cache.h"
+#include "../mpi_dispatch.h"
+#include "../mpi_output.h"
+#include "../mpi_overlap.h"
+#include "../mpi_scatter.h"
+#include "../mpi_threads.h"
+#include "../trace.h"
+
+// Ranks split the rows of the final edge image into blocks. Every stage only
+// computes the rows that line up with the rank's block and gets the rows it
+// reads beyond the block from the neighbouring ranks, one halo row on each
+// side, so a stage sends O(width) bytes per rank instead of gathering the
+// whole image everywhere. The Gaussian reads its gaussian_size / 2 halo rows
+// on each side straight from the input rows rank 0 scatters with the block.
+// Only the classified edges are gathered, to rank 0, which runs hysteresis,
+// unless every rank writes its own rows to a shared file: then hysteresis
+// runs across the ranks too and nothing is gathered.
+
+// Rows of one stage held by a rank: its own rows [start_y, end_y) and halo
+// rows [first_y, start_y) and [end_y, last_y) owned by its neighbours. Rows
+// are global indices into the stage's output
+struct RowBlock {
+    int first_y, start_y, end_y, last_y;
+
+    int above() const { return start_y - first_y; }
+    int below() const { return last_y - end_y; }
+    int rows() const { return last_y - first_y; }
+    int ownRows() const { return end_y - start_y; }
+};
 
-struct CannyInfo {
-    int start_y, end_y;
-    float* global_image;
+// Smoothed rows for final rows [start_y, end_y). Final row y reads smoothed
+// rows y to y+2, whose middle rows belong to this rank. The first and last
+// ranks also own the smoothed rows nobody else reads
+RowBlock smoothedRows(int start_y, int end_y, int height) {
+    return {start_y, start_y == 0 ? 0 : start_y + 1,
+        end_y == height ? height + 2 : end_y + 1, end_y + 2};
+}
 
-    int width;
-    float* local_image;
-    float* local_direction;
-};
+// Gradient rows for final rows [start_y, end_y). Non-maximum suppression reads
+// one row above and below, except at the image border
+RowBlock gradientRows(int start_y, int end_y, int height) {
+    return {std::max(start_y - 1, 0), start_y, end_y, std::min(end_y + 1, height)};
+}
 
-void gaussianFilter(CannyInfo* canny) {
-    // generate gaussian kernel
-    float sum = 0.0f;
-    float** gaussian_kernel = new float*[gaussian_kernel_size];
-    int gaussian_kernel_radius = gaussian_kernel_size / 2;
-
-    for (int y = -gaussian_kernel_radius; y <= gaussian_kernel_radius; ++y) {
-        int y_idx = y + gaussian_kernel_radius;
-        gaussian_kernel[y_idx] = new float[gaussian_kernel_size];
-        for (int x = -gaussian_kernel_radius; x <= gaussian_kernel_radius; ++x) {
-            int x_idx = x + gaussian_kernel_radius;
-            float temp = exp(-(x * x + y * y) / (2 * gaussian_sd * gaussian_sd)) / 
-                (2 * M_PI * gaussian_sd * gaussian_sd);
-            sum += temp;
-            gaussian_kernel[y_idx][x_idx] = temp;
-        }
-    }
+// Halo rows in flight between a rank and its neighbours
+struct HaloExchange {
+    MPI_Request requests[4];
+};
 
-    // normalize gaussian kernel
-    for (int i = 0; i < gaussian_kernel_size; ++i) {
-        for (int j = 0; j < gaussian_kernel_size; ++j) {
-            gaussian_kernel[i][j] /= sum;
-        }
-    }
+// `rows` holds block.rows() rows. Posts the sends of this rank's first and last
+// own rows to its neighbours and the receives of theirs into the halo rows
+template <typename T>
+HaloExchange startHaloExchange(ImageBuffer<T>* rows, const RowBlock& block, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    int up = block.above() ? rank - 1 : MPI_PROC_NULL;
+    int down = block.below() ? rank + 1 : MPI_PROC_NULL;
+    int row_bytes = rows->stride * sizeof(T);
+    int own_end = block.above() + block.ownRows();
+
+    // tag 0 travels up, tag 1 travels down
+    HaloExchange exchange;
+    MPI_Irecv((*rows)[0], block.above() * row_bytes, MPI_BYTE, up, 1,
+        comm, &exchange.requests[0]);
+    MPI_Irecv((*rows)[own_end], block.below() * row_bytes, MPI_BYTE, down, 0,
+        comm, &exchange.requests[1]);
+    MPI_Isend((*rows)[block.above()], block.above() * row_bytes, MPI_BYTE, up, 0,
+        comm, &exchange.requests[2]);
+    MPI_Isend((*rows)[own_end - block.below()], block.below() * row_bytes, MPI_BYTE, down, 1,
+        comm, &exchange.requests[3]);
+    return exchange;
+}
 
-    // start doing filter
-    float* image = canny->global_image;
-    int start_y = canny->start_y;
-    int end_y = canny->end_y;
-    int height = end_y - start_y;
-    int width = canny->width;
-    int new_width = getOutputWidth(width, gaussian_kernel_size);
-    float* new_image = new float[height * new_width];
-
-    for (int y = start_y; y < end_y; ++y) {
-        for (int x = 0; x < new_width; ++x) {
-            float magnitude = 0.0f;
-            for (int i = 0; i < gaussian_kernel_size; ++i) {
-                for (int j = 0; j < gaussian_kernel_size; ++j) {
-                    int img_idx = (y + i) * width + x + j;
-                    magnitude += gaussian_kernel[i][j] * image[img_idx];
-                }
-            }
+void finishHaloExchange(HaloExchange* exchange, MpiWaitTimes* wait_times) {
+    timeWait(&wait_times->halo, [&]() {
+        TRACE_SCOPE("MPI_Waitall");
+        MPI_Waitall(4, exchange->requests, MPI_STATUSES_IGNORE);
+    });
+}
 
-            int fill_idx = (y - start_y) * new_width + x;
-            new_image[fill_idx] = magnitude;
-        }
+// Runs stage(start, end) over rows [start_y, end_y) of a stage that reads the
+// halo rows `exchange` brings in. Only the first `above` and the last `below`
+// rows read a halo row. With overlap the other rows are computed while the
+// halo is in flight, otherwise the stage waits for it first. The rows are
+// shared among the rank's threads either way
+template <typename Stage>
+void runAfterHalo(HaloExchange* exchange, int start_y, int end_y, int above, int below,
+    bool overlap, MpiWaitTimes* wait_times, Stage stage
+) {
+    if (!overlap) {
+        finishHaloExchange(exchange, wait_times);
+        parallelRows(start_y, end_y, stage);
+        return;
     }
 
-    delete[] gaussian_kernel;
-    canny->local_image = new_image;
-    canny->width = new_width;
+    int inner_start = std::min(start_y + above, end_y);
+    int inner_end = std::max(end_y - below, inner_start);
+    parallelRows(inner_start, inner_end, stage);
+    finishHaloExchange(exchange, wait_times);
+    parallelRows(start_y, inner_start, stage);
+    parallelRows(inner_end, end_y, stage);
 }
 
-void computeGradients(CannyInfo* canny) {
-    float* image = canny->global_image;
-    int start_y = canny->start_y;
-    int end_y = canny->end_y;
-    int height = end_y - start_y;
-    int width = canny->width;
-    int new_width = getOutputWidth(width, sobel_kernel_size);
-    float* new_image = new float[height * new_width];
-    float* direction = new float[height * new_width];
-
-    for (int y = start_y; y < end_y; ++y) {
-        for (int x = 0; x < new_width; ++x) {
-            float sum_x = 0.0f;
-            float sum_y = 0.0f;
-
-            for (int i = 0; i < sobel_kernel_size; ++i) {
-                for (int j = 0; j < sobel_kernel_size; ++j) {
-                    int img_idx = (y + i) * width + x + j;
-                    sum_x += sobel_x[i][j] * image[img_idx];
-                    sum_y += sobel_y[i][j] * image[img_idx];
-                }
-            }
-
-            sum_x = std::abs(sum_x);
-            sum_y = std::abs(sum_y);
+// edges on rank 0 after the gather. With threads, the union-find labelling
+// gives the same edges as the flood fill
+void hysteresis(ImageView<uint8_t> edges) {
+    TRACE_SCOPE("hysteresis");
+    if (rankThreads() > 1) {
+        hysteresisUnionFind(edges, rankThreads());
+    } else {
+        hysteresisFloodFill(edges);
+    }
+}
 
-            int fill_idx = (y - start_y) * new_width + x;
-            float magnitude = std::sqrt(sum_x * sum_x + sum_y * sum_y);
-            new_image[fill_idx] = std::min(255.0f, magnitude);
-            direction[fill_idx] = std::atan2(sum_y, sum_x) * 180 / M_PI;
+// Hysteresis across the ranks. `edges` holds the block.rows() rows of edge
+// classes around this rank's block. Every round swaps the rows on either side
+// of the block and floods from every strong pixel the rank holds, so an edge
+// crosses one block border per round. Rounds repeat until no rank promotes one
+// of its own pixels, which leaves the same edges as a flood fill over the
+// whole image. Only the own rows are final afterwards
+void hysteresisRows(ImageBuffer<uint8_t>* edges, const RowBlock& block, MPI_Comm comm,
+    MpiWaitTimes* wait_times
+) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    int own_start = block.above();
+    int own_end = own_start + block.ownRows();
+    while (true) {
+        HaloExchange exchange = startHaloExchange(edges, block, comm);
+        finishHaloExchange(&exchange, wait_times);
+        int promoted;
+        {
+            TRACE_SCOPE("hysteresis");
+            promoted = promoteWeakEdges(edges->view(), own_start, own_end);
         }
+        if (size == 1) { break; }
+
+        int total;
+        timeWait(&wait_times->halo, [&]() {
+            TRACE_SCOPE("MPI_Allreduce");
+            MPI_Allreduce(&promoted, &total, 1, MPI_INT, MPI_SUM, comm);
+        });
+        if (total == 0) { break; }
     }
-
-    delete[] canny->local_image;
-    canny->local_image = new_image;
-    canny->local_direction = direction;
-    canny->width = new_width;
+    dropWeakEdges(edges->roi(0, own_start, edges->width, block.ownRows()));
 }
 
-void nonMaxSuppression(CannyInfo* canny) {
-    float* image = canny->global_image;
-    int start_y = canny->start_y;
-    int end_y = canny->end_y;
-    int height = end_y - start_y;
-    int width = canny->width;
-    float* new_image = new float[height * width];
-
-    for (int y = start_y; y < end_y; ++y) {
-        int local_y = y - start_y;
-        new_image[local_y*width] = image[y*width];
-        new_image[local_y*width+width-1] = image[y*width+width-1];
-
-        for (int x = 1; x < width-1; ++x) {
-            float direction = canny->local_direction[local_y*width+x];
-            float magnitude = canny->local_image[local_y*width+x];
-            float first_pixel = 0.0f;
-            float second_pixel = 0.0f;
-
-            if ((direction >= -22.5f && direction < 22.5f) || 
-                (direction >= 157.5f / 8 && direction < -157.5f)) {
-                // fall in 0 degree direction area
-                first_pixel = image[y*width+x-1];
-                second_pixel = image[y*width+x+1];
-            } else if ((direction >= 22.5f && direction < 67.5f) ||
-                        (direction >= -157.5f && direction < -112.5f)) {
-                // fall in 45 degree direction area
-                first_pixel = image[(y-1)*width+x-1];
-                second_pixel = image[(y+1)*width+x+1];
-            } else if ((direction >= 67.5f && direction < 112.5f) ||
-                        (direction >= -112.5f && direction < -67.5f)) {
-                // fall in 90 degree direction area
-                first_pixel = image[(y-1)*width+x];
-                second_pixel = image[(y+1)*width+x];
-            } else if ((direction >= 112.5f && direction < 157.5f) ||
-                        (direction >= -67.5f && direction < -22.5f)) {
-                // fall in 135 degree direction area
-                first_pixel = image[(y-1)*width+x+1];
-                second_pixel = image[(y+1)*width+x-1];
-            }
-
-            if (magnitude >= first_pixel && magnitude >= second_pixel) {
-                new_image[local_y*width+x] = magnitude;
-            } else {
-                new_image[local_y*width+x] = 0.0f;
-            }
+// Every rank sends its `rows`, rank 0 receives them in rank order into `image`,
+// which it allocated at full size. All buffers have the same width and so the
+// same row stride, which lets padded rows be sent as they are
+template <typename T>
+void gatherRows(ImageView<const T> rows, ImageBuffer<T>* image, int height,
+    int rows_per_process, MPI_Comm comm
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int row_bytes = rows.stride * sizeof(T);
+    int recv_counts[size];
+    int displs[size];
+    for (int i = 0; i < size; ++i) {
+        if (i == size - 1) {
+            recv_counts[i] = (height - (rows_per_process * i)) * row_bytes;
+        } else {
+            recv_counts[i] = rows_per_process * row_bytes;
         }
+        displs[i] = i * rows_per_process * row_bytes;
     }
 
-    delete[] canny->local_image;
-    canny->local_image = new_image;
+    T* receive = (rank == 0) ? image->data : nullptr;
+    TRACE_SCOPE("MPI_Gatherv");
+    MPI_Gatherv(rows.data, rows.height * row_bytes, MPI_BYTE,
+        receive, recv_counts, displs, MPI_BYTE, 0, comm);
 }
 
-void doubleThreshold(CannyInfo* canny) {
-    float* image = canny->global_image;
-    int start_y = canny->start_y;
-    int end_y = canny->end_y;
-    int height = end_y - start_y;
-    int width = canny->width;
-    float* new_image = new float[height * width];
-
-    for (int y = start_y; y < end_y; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int img_idx = y * width + x;
-            int fill_idx = (y - start_y) * width + x;
-            if (image[img_idx] >= high_threshold) {
-                // strong edge
-                new_image[fill_idx] = 255.0f;
-            } else if (image[img_idx] >= low_threshold) {
-                // weak edge, check if it is connected to strong edge
-                bool found_strong = false;
-                for (int dy = -1; dy <= 1; ++dy) {
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        if (y + dy < 0 || y + dy >= height ||
-                            x + dx < 0 || x + dx >= width) {
-                            continue;
-                        }
-                        img_idx = (y + dy) * width + x + dx;
-                        if (image[img_idx] >= high_threshold) {
-                            found_strong = true;
-                            break;
-                        }
-                    }
-                    if (found_strong) { break; }
-                }
+// Ends both pipelines with the edge classes of this rank's rows in `edges`,
+// laid out as gradientRows. With no shared_path the classes are gathered to
+// rank 0, which runs hysteresis and gets the edges back in image. Otherwise
+// the ranks run hysteresis together and each writes its rows into the PGM
+// at shared_path, and image is left as it was
+void finishEdges(GrayImage* image, ImageBuffer<uint8_t>* edges, const RowBlock& block,
+    int height, int rows_per_process, const std::string& shared_path, MPI_Comm comm,
+    MpiWaitTimes* wait_times
+) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    int width = edges->width;
+    ImageView<uint8_t> own_edges = edges->roi(0, block.above(), width, block.ownRows());
+
+    if (!shared_path.empty()) {
+        hysteresisRows(edges, block, comm, wait_times);
+        timeWait(&wait_times->save, [&]() {
+            writeRowsPGM(shared_path, own_edges, width, height, block.start_y, comm);
+        });
+        return;
+    }
 
-                if (found_strong) {
-                    new_image[fill_idx] = 255.0f;
-                }
-            } else {
-                // suppress
-                new_image[fill_idx] = 0.0f;
-            }
-        }
+    // hysteresis follows edges across rank borders, so only rank 0 gets the
+    // classes and runs it
+    ImageBuffer<uint8_t> new_image;
+    if (rank == 0) {
+        new_image = ImageBuffer<uint8_t>(width, height);
+    }
+    timeWait(&wait_times->gather, [&]() {
+        gatherRows<uint8_t>(own_edges, &new_image, height, rows_per_process, comm);
+    });
+
+    // hand the result back to GrayImage
+    if (rank == 0) {
+        hysteresis(new_image.view());
+        image->assign(std::move(new_image));
     }
+}
 
-    delete[] canny->local_image;
-    canny->local_image = new_image;
+// Input rows of this rank's block from rank 0's `image`, see scatterRows.
+// Row 0 is the first row its smoothed rows read, since the smoothed rows start
+// at the same global row as the block
+ImageView<const uint8_t> scatterInput(GrayImage* image, int input_width, int input_height,
+    int rows_per_process, const CannyConfig& config, ImageBuffer<uint8_t>* local,
+    MPI_Comm comm, MpiWaitTimes* wait_times
+) {
+    const int halo = (config.gaussian_size - 1) + (gradient_kernel_size - 1);
+    ImageView<const uint8_t> input;
+    timeWait(&wait_times->scatter, [&]() {
+        input = scatterRows(image ? image->pixelView() : ImageView<const uint8_t>(),
+            input_width, input_height, rows_per_process, halo, local, comm);
+    });
+    return input;
 }
 
-void cannyMPI(GrayImage* image, int rank, int size) {
-    int height = image->height;
-    int width = image->width;
-    float* global_image = new float[height * width];
-    for (int i = 0; i < height; ++i) {
-        float* dest_pos = global_image + i * width;
-        memcpy(dest_pos, image->image[i], width * sizeof(float));
+// same calling convention as cannyMPI
+bool cannyIntegerMPI(GrayImage* image, MPI_Comm comm, const CannyConfig& config, bool overlap,
+    const std::string& shared_path, MpiWaitTimes* wait_times
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int input_width, input_height;
+    broadcastImageSize(image, comm, &input_width, &input_height);
+    if (input_width == 0) { return false; }
+    if (getFusedOutputWidth(input_width, config) <= 0 ||
+        getFusedOutputHeight(input_height, config) <= 0) {
+        skipSmallImage(image, input_width, input_height, comm);
+        return false;
     }
 
-    // first do gaussian filter
-    height = getOutputHeight(height, gaussian_kernel_size);
+    int smoothed_width = getOutputWidth(input_width, config.gaussian_size);
+    int width = getOutputWidth(smoothed_width, gradient_kernel_size);
+    int height = getFusedOutputHeight(input_height, config);
     int rows_per_process = height / size;
     int start_y = rank * rows_per_process;
     int end_y = (rank == size - 1) ? height : start_y + rows_per_process;
 
-    CannyInfo canny;
-    canny.width = width;
-    canny.global_image = global_image;
-    canny.start_y = start_y;
-    canny.end_y = end_y;
-    gaussianFilter(&canny);
-
-    width = canny.width;
-    int recv_counts[size];
-    int displs[size];
-    for (int i = 0; i < size; ++i) {
-        if (i == size - 1) {
-            recv_counts[i] = (height - (rows_per_process * i)) * width;
-        } else {
-            recv_counts[i] = rows_per_process * width;
-        }
-
-        if (i == 0) {
-            displs[i] = 0;
-        } else {
-            displs[i] = displs[i-1] + recv_counts[i-1];
-        }
+    ImageBuffer<uint8_t> local_pixels;
+    ImageView<const uint8_t> local_input = scatterInput(image, input_width, input_height,
+        rows_per_process, config, &local_pixels, comm, wait_times);
+    GaussianFixedKernel gaussian = makeGaussianFixedKernel(config);
+
+    // edge classes keep a halo row on each side for hysteresis across ranks
+    RowBlock edge_rows = start_y < end_y ? gradientRows(start_y, end_y, height) :
+        RowBlock{start_y, start_y, start_y, start_y};
+    ImageBuffer<uint8_t> edges(width, edge_rows.rows());
+    if (start_y < end_y) {
+        RowBlock smoothed_rows = smoothedRows(start_y, end_y, height);
+        ImageBuffer<uint8_t> smoothed(smoothed_width, smoothed_rows.rows());
+        parallelRows(smoothed_rows.above(), smoothed_rows.above() + smoothed_rows.ownRows(),
+            [&](int from_y, int to_y) {
+                TRACE_SCOPE("gaussianFilter");
+                gaussianIntegerRows(local_input, smoothed.view(), gaussian, from_y, to_y);
+            });
+        HaloExchange exchange = startHaloExchange(&smoothed, smoothed_rows, comm);
+
+        // directions are only read on the rank that computed them
+        RowBlock gradient_rows = gradientRows(start_y, end_y, height);
+        int own_height = end_y - start_y;
+        ImageBuffer<int32_t> magnitude(width, gradient_rows.rows());
+        ImageBuffer<uint8_t> direction(width, gradient_rows.rows());
+        ImageView<int32_t> own_magnitude = magnitude.roi(0, gradient_rows.above(), width, own_height);
+        ImageView<uint8_t> own_direction = direction.roi(0, gradient_rows.above(), width, own_height);
+        runAfterHalo(&exchange, 0, own_height, smoothed_rows.above(), smoothed_rows.below(),
+            overlap, wait_times, [&](int from_y, int to_y) {
+                TRACE_SCOPE("computeGradients");
+                gradientIntegerRows(smoothed.view(), own_magnitude, own_direction,
+                    config.gradient, from_y, to_y);
+            });
+        exchange = startHaloExchange(&magnitude, gradient_rows, comm);
+
+        ImageBuffer<int32_t> suppressed(width, gradient_rows.rows());
+        runAfterHalo(&exchange, gradient_rows.above(), gradient_rows.above() + own_height,
+            gradient_rows.above(), gradient_rows.below(), overlap, wait_times,
+            [&](int from_y, int to_y) {
+                TRACE_SCOPE("nonMaxSuppression");
+                nonMaxSuppressionIntegerRows(magnitude.view(), direction.view(),
+                    suppressed.view(), from_y, to_y);
+            });
+        ImageView<int32_t> own_suppressed =
+            suppressed.roi(0, gradient_rows.above(), width, own_height);
+        ImageView<uint8_t> own_edges = edges.roi(0, edge_rows.above(), width, own_height);
+        parallelRows(0, own_height, [&](int from_y, int to_y) {
+            TRACE_SCOPE("doubleThreshold");
+            doubleThresholdIntegerRows(own_suppressed, own_edges, config, from_y, to_y);
+        });
     }
 
-    delete[] global_image;
-    global_image = new float[height * width];
-    MPI_Allgatherv(canny.local_image, recv_counts[rank], MPI_FLOAT, 
-        global_image, recv_counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
-    canny.global_image = global_image;
-
-    // then do compute gradients
-    height = getOutputHeight(height, sobel_kernel_size);
-    rows_per_process = height / size;
-    start_y = rank * rows_per_process;
-    end_y = (rank == size - 1) ? height : start_y + rows_per_process;
-    canny.start_y = start_y;
-    canny.end_y = end_y;
-    computeGradients(&canny);
-
-    width = canny.width;
-    for (int i = 0; i < size; ++i) {
-        if (i == size - 1) {
-            recv_counts[i] = (height - (rows_per_process * i)) * width;
-        } else {
-            recv_counts[i] = rows_per_process * width;
-        }
+    finishEdges(image, &edges, edge_rows, height, rows_per_process, shared_path, comm,
+        wait_times);
+    return true;
+}
 
-        if (i == 0) {
-            displs[i] = 0;
-        } else {
-            displs[i] = displs[i-1] + recv_counts[i-1];
-        }
+// Rank 0 passes the image it decoded as uint8 and gets the edges back in it,
+// the other ranks pass nullptr and receive their rows from rank 0. With
+// overlap, halo rows travel while the rows that do not need them are
+// computed, otherwise every stage waits for its halo before it starts. With a
+// shared_path, every rank writes its edges there instead, see finishEdges.
+// Returns false on every rank when there are no edges to save: rank 0 failed
+// to decode the image or it is too small for the kernels
+bool cannyMPI(GrayImage* image, MPI_Comm comm, const CannyConfig& config, bool overlap,
+    const std::string& shared_path, MpiWaitTimes* wait_times
+) {
+    if (config.integer) {
+        return cannyIntegerMPI(image, comm, config, overlap, shared_path, wait_times);
     }
 
-    delete[] global_image;
-    global_image = new float[height * width];
-    MPI_Allgatherv(canny.local_image, recv_counts[rank], MPI_FLOAT, 
-        global_image, recv_counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
-    canny.global_image = global_image;
-
-    // then do non-maximum suppression. Size didn't change
-    nonMaxSuppression(&canny);
-    delete[] global_image;
-    global_image = new float[height * width];
-    MPI_Allgatherv(canny.local_image, recv_counts[rank], MPI_FLOAT, 
-        global_image, recv_counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
-    canny.global_image = global_image;
-
-    // finally do double threshold. Size didn't change
-    doubleThreshold(&canny);
-    delete[] global_image;
-    global_image = new float[height * width];
-    MPI_Allgatherv(canny.local_image, recv_counts[rank], MPI_FLOAT, 
-        global_image, recv_counts, displs, MPI_FLOAT, MPI_COMM_WORLD);
-    canny.global_image = global_image;
-
-    // convert back to GrayImage
-    if (rank == 0) {
-        float** new_image = new float*[height];
-        for (int i = 0; i < height; ++i) {
-            float* src_pos = canny.global_image + i * width;
-            new_image[i] = new float[width];
-            memcpy(new_image[i], src_pos, width * sizeof(float));
-        }
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int input_width, input_height;
+    broadcastImageSize(image, comm, &input_width, &input_height);
+    if (input_width == 0) { return false; }
+    if (getFusedOutputWidth(input_width, config) <= 0 ||
+        getFusedOutputHeight(input_height, config) <= 0) {
+        skipSmallImage(image, input_width, input_height, comm);
+        return false;
+    }
 
-        for (int i = 0; i < image->height; ++i) {
-            delete[] image->image[i];
-        }
-        delete[] image->image;
+    int smoothed_width = getOutputWidth(input_width, config.gaussian_size);
+    int width = getOutputWidth(smoothed_width, gradient_kernel_size);
+    int height = getFusedOutputHeight(input_height, config);
+    int rows_per_process = height / size;
+    int start_y = rank * rows_per_process;
+    int end_y = (rank == size - 1) ? height : start_y + rows_per_process;
 
-        image->image = new_image;
-        image->height = height;
-        image->width = width;
+    ImageBuffer<uint8_t> local_pixels;
+    ImageBuffer<float> local_input = widenPixels(scatterInput(image, input_width, input_height,
+        rows_per_process, config, &local_pixels, comm, wait_times), rankThreads() > 1);
+    GaussianKernel gaussian = makeGaussianKernel(config.gaussian_size, config.gaussian_sd);
+
+    // edge classes keep a halo row on each side for hysteresis across ranks
+    RowBlock edge_rows = start_y < end_y ? gradientRows(start_y, end_y, height) :
+        RowBlock{start_y, start_y, start_y, start_y};
+    ImageBuffer<uint8_t> edges(width, edge_rows.rows());
+    if (start_y < end_y) {
+        // first do gaussian filter
+        RowBlock smoothed_rows = smoothedRows(start_y, end_y, height);
+        ImageBuffer<float> smoothed(smoothed_width, smoothed_rows.rows());
+        int smoothed_start = smoothed_rows.above();
+        int smoothed_end = smoothed_start + smoothed_rows.ownRows();
+        parallelRows(smoothed_start, smoothed_end, [&](int from_y, int to_y) {
+            TRACE_SCOPE("gaussianFilter");
+            gaussianFilterRows(local_input.view(), smoothed.view(), gaussian, config.gaussian,
+                from_y, to_y);
+        });
+        HaloExchange exchange = startHaloExchange(&smoothed, smoothed_rows, comm);
+
+        // then do compute gradients
+        RowBlock gradient_rows = gradientRows(start_y, end_y, height);
+        int own_height = end_y - start_y;
+        ImageBuffer<float> magnitude(width, gradient_rows.rows());
+        ImageBuffer<uint8_t> direction(width, gradient_rows.rows());
+        ImageView<float> own_magnitude = magnitude.roi(0, gradient_rows.above(), width, own_height);
+        ImageView<uint8_t> own_direction = direction.roi(0, gradient_rows.above(), width, own_height);
+        runAfterHalo(&exchange, 0, own_height, smoothed_rows.above(), smoothed_rows.below(),
+            overlap, wait_times, [&](int from_y, int to_y) {
+                TRACE_SCOPE("computeGradients");
+                computeGradientRows(smoothed.view(), own_magnitude, own_direction,
+                    config.gradient, from_y, to_y);
+            });
+        exchange = startHaloExchange(&magnitude, gradient_rows, comm);
+
+        // then do non-maximum suppression. Size didn't change
+        ImageBuffer<float> suppressed(width, gradient_rows.rows());
+        runAfterHalo(&exchange, gradient_rows.above(), gradient_rows.above() + own_height,
+            gradient_rows.above(), gradient_rows.below(), overlap, wait_times,
+            [&](int from_y, int to_y) {
+                TRACE_SCOPE("nonMaxSuppression");
+                nonMaxSuppressionRows(magnitude.view(), direction.view(),
+                    suppressed.view(), from_y, to_y);
+            });
+
+        // finally do double threshold. Size didn't change
+        ImageView<float> own_suppressed =
+            suppressed.roi(0, gradient_rows.above(), width, own_height);
+        ImageView<uint8_t> own_edges = edges.roi(0, edge_rows.above(), width, own_height);
+        parallelRows(0, own_height, [&](int from_y, int to_y) {
+            TRACE_SCOPE("doubleThreshold");
+            classifyEdgeRows(own_suppressed, own_edges, config, from_y, to_y);
+        });
     }
 
-    // clean up
-    delete[] canny.local_image;
-    delete[] canny.local_direction;
-    delete[] global_image;
+    finishEdges(image, &edges, edge_rows, height, rows_per_process, shared_path, comm,
+        wait_times);
+    return true;
 }
 
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    initMpiThreads(&argc, &argv);
 
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
     bool verbose = false;
-    if (argc > 1) {
-        auto arg1 = std::string(argv[1]);
-        if (arg1 == "-v" || arg1 == "--verbose") {
-            verbose = true;
+    CannyConfig config = parseCannyArgs(argc, argv, &verbose);
+    MpiDistribution distribution = parseMpiDistribution(argc, argv);
+    bool overlap = parseMpiOverlapArg(argc, argv);
+    MpiOutput output = parseMpiOutput(argc, argv);
+    int threads = parseRankThreadsArg(argc, argv);
+    std::string trace_path = parseTraceArg(argc, argv);
+    // the hybrid executables are these sources built with OpenMP
+    std::string backend = hybrid_build ? "hybrid" : "mpi";
+
+    if (rank == 0) {
+        std::cout << "==========" << (hybrid_build ? "Hybrid" : "MPI")
+            << " Canny==========" << std::endl;
+        std::cout << "Distributing " << (distribution == MpiDistribution::Images ?
+            "whole images" : "image rows") << " to ranks" << std::endl;
+        if (overlap) {
+            std::cout << "Overlapping communication and saving with compute" << std::endl;
+        }
+        if (output == MpiOutput::SharedFile) {
+            std::cout << "Writing output with MPI-IO" << std::endl;
         }
     }
-
+    setupRankThreads(threads, MPI_COMM_WORLD, verbose);
     if (rank == 0) {
-        std::cout << "==========MPI Canny==========" << std::endl;
         std::cout << "Loading images..." << std::endl;
     }
 
-    std::vector<GrayImage*> images = getBSDS500Images(verbose);
+    // images are decoded as uint8, the float kernels widen the rows they compute on
+    PixelFormat format = PixelFormat::UInt8;
+    // rank 0 builds a missing cache before the other ranks map it
+    std::string cache_path = parseImageCacheArg(argc, argv);
+    ImageCache cache;
+    std::vector<ImageSource> sources;
+    if (rank == 0) {
+        sources = listDatasetImages(cache_path, &cache, verbose);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank != 0) {
+        sources = listDatasetImages(cache_path, &cache, verbose);
+    }
+
 
     if (rank == 0) {
         std::cout << "Start processing images..." << std::endl;
     }
 
+    MpiWaitTimes wait_times;
+    std::string output_dir = "../canny_outputs/" + backend;
+    ImageSaver saver(output_dir, overlap, verbose);
+    bool shared_file = output == MpiOutput::SharedFile;
+    if (shared_file) {
+        createOutputDirectory(output_dir, MPI_COMM_WORLD);
+    }
     MPI_Barrier(MPI_COMM_WORLD);
+    if (!trace_path.empty()) {
+        traceStart(rank, "Rank " + std::to_string(rank));
+    }
     auto start = chrono::high_resolution_clock::now();
-    for (auto& image : images) {
-        std::string message = "Processing image [" + image->file_name + "]...";
-        if (verbose && rank == 0) {
-            std::cout << "Processing image ["
-                << image->file_name << "]..." << std::endl;
+    if (distribution == MpiDistribution::Images) {
+        // each rank decodes only the images it is dealt
+        int processed = distributeImages(sources.size(), MPI_COMM_WORLD, [&](int index) {
+            for (auto& image : loadImages({sources[index]}, verbose, format)) {
+                if (verbose) {
+                    std::cout << "Processing image [" << image->file_name
+                        << "] on rank " << rank << "..." << std::endl;
+                }
+                if (shared_file) {
+                    // every rank writes its own files, as the only rank of the file
+                    cannyMPI(image, MPI_COMM_SELF, config, overlap,
+                        pgmOutputPath(output_dir, image->file_name), &wait_times);
+                    delete image;
+                } else if (cannyMPI(image, MPI_COMM_SELF, config, overlap, "", &wait_times)) {
+                    saver.save(image, &wait_times);
+                } else {
+                    delete image;
+                }
+            }
+        });
+        if (verbose) {
+            std::cout << "Rank " << rank << " processed " << processed
+                << " images" << std::endl;
         }
-        cannyMPI(image, rank, size);
-
-        if (rank == 0) {
-            image->saveImage("../canny_outputs/mpi");
-            if (verbose) {
-                std::cout << "Saved output of image [" 
-                    << image->file_name << "] successfully" << std::endl;
+    } else {
+        // only rank 0 decodes, the other ranks get their rows from it
+        for (size_t i = 0; i < sources.size(); ++i) {
+            GrayImage* image = nullptr;
+            if (rank == 0) {
+                std::vector<GrayImage*> loaded = loadImages({sources[i]}, verbose, format);
+                image = loaded.empty() ? nullptr : loaded[0];
+            }
+            if (verbose && image) {
+                std::cout << "Processing image ["
+                    << image->file_name << "]..." << std::endl;
+            }
+            // every rank knows the file name, even if rank 0 fails to decode it
+            std::string shared_path = shared_file ?
+                pgmOutputPath(output_dir, sources[i].file_name) : "";
+            bool done = cannyMPI(image, MPI_COMM_WORLD, config, overlap, shared_path,
+                &wait_times);
+
+            if (image && (shared_file || !done)) {
+                delete image;
+            } else if (image) {
+                saver.save(image, &wait_times);
             }
         }
-        delete image;
     }
+    saver.finish(&wait_times);
     MPI_Barrier(MPI_COMM_WORLD);
 
     if (rank == 0) {
         auto end = chrono::high_resolution_clock::now();
         auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
         std::cout << "Duration: " << duration.count() << " ns" << std::endl;
+        BufferPoolStats pool_stats = bufferPoolStats();
+        std::cout << "Image buffers: " << pool_stats.heap_allocations << " allocated, "
+            << pool_stats.reuses << " reused" << std::endl;
+    }
+    reportWaitTimes(wait_times, MPI_COMM_WORLD);
+    if (!trace_path.empty()) {
+        writeTraceMPI(trace_path, MPI_COMM_WORLD);
     }
 
     MPI_Finalize();
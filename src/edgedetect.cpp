@@ -0,0 +1,93 @@
+#include <stdexcept>
+#include <string>
+#include "edgedetect.h"
+#include "canny/canny_cpu.h"
+#include "canny/canny_cuda.h"
+#include "canny/canny_fused.h"
+#include "sobel/sobel_cpu.h"
+#include "sobel/sobel_cuda.h"
+
+namespace {
+
+bool usesIntegerKernels(EdgeAlgorithm algorithm, const EdgeParams& params) {
+    return algorithm == EdgeAlgorithm::Sobel ? params.sobel.integer : params.canny.integer;
+}
+
+void checkOutputSize(int width, int height, ImageView<uint8_t> output,
+    EdgeAlgorithm algorithm, const EdgeParams& params
+) {
+    if (algorithm == EdgeAlgorithm::Canny) {
+        std::string error = cannyConfigError(params.canny);
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+    int output_width = edgeOutputWidth(algorithm, width, params);
+    int output_height = edgeOutputHeight(algorithm, height, params);
+    if (output_width <= 0 || output_height <= 0) {
+        throw std::runtime_error("Image of " + std::to_string(width) + "x" +
+            std::to_string(height) + " is smaller than the kernels");
+    }
+    if (output.width != output_width || output.height != output_height) {
+        throw std::runtime_error("Edge image must be " + std::to_string(output_width) +
+            "x" + std::to_string(output_height) + ", got " + std::to_string(output.width) +
+            "x" + std::to_string(output.height));
+    }
+}
+
+}
+
+int edgeOutputWidth(EdgeAlgorithm algorithm, int width, const EdgeParams& params) {
+    return algorithm == EdgeAlgorithm::Sobel ?
+        getOutputWidth(width) : getFusedOutputWidth(width, params.canny);
+}
+
+int edgeOutputHeight(EdgeAlgorithm algorithm, int height, const EdgeParams& params) {
+    return algorithm == EdgeAlgorithm::Sobel ?
+        getOutputHeight(height) : getFusedOutputHeight(height, params.canny);
+}
+
+void detectEdges(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    EdgeAlgorithm algorithm, EdgeBackend backend, const EdgeParams& params
+) {
+    bool parallel = backend == EdgeBackend::OpenMP;
+    if (!usesIntegerKernels(algorithm, params)) {
+        ImageBuffer<float> widened = widenPixels(input, parallel);
+        detectEdges(widened.view(), output, algorithm, backend, params);
+        return;
+    }
+
+    checkOutputSize(input.width, input.height, output, algorithm, params);
+    if (backend == EdgeBackend::CUDA) {
+        throw std::runtime_error("The integer kernels have no CUDA backend");
+    }
+    if (algorithm == EdgeAlgorithm::Sobel) {
+        sobelIntegerCPU(input, output, parallel);
+    } else {
+        cannyIntegerCPU(input, output, params.canny, parallel);
+    }
+}
+
+void detectEdges(ImageView<const float> input, ImageView<uint8_t> output,
+    EdgeAlgorithm algorithm, EdgeBackend backend, const EdgeParams& params
+) {
+    checkOutputSize(input.width, input.height, output, algorithm, params);
+    if (usesIntegerKernels(algorithm, params)) {
+        throw std::runtime_error("The integer kernels take uint8 pixels");
+    }
+
+    bool parallel = backend == EdgeBackend::OpenMP;
+    if (algorithm == EdgeAlgorithm::Sobel) {
+        if (backend == EdgeBackend::CUDA) {
+            sobelCUDA(input, output);
+        } else {
+            sobelCPU(input, output, getSobelRowKernel(params.sobel.simd), parallel);
+        }
+    } else {
+        if (backend == EdgeBackend::CUDA) {
+            cannyCUDA(input, output, params.canny);
+        } else {
+            cannyCPU(input, output, params.canny, parallel);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef EDGEDETECT_H
+#define EDGEDETECT_H
+#include <cstdint>
+#include "image_buffer.h"
+#include "canny/canny.h"
+#include "sobel/sobel.h"
+
+// Public interface of libedgedetect: the kernels of the executables behind
+// one call on buffers the caller owns. Nothing here loads or saves images or
+// keeps state between calls, so it can be called from any thread of a larger
+// program. Scratch buffers come from the buffer pool (see buffer_pool.h).
+
+enum class EdgeAlgorithm {
+    Sobel,
+    Canny
+};
+
+enum class EdgeBackend {
+    // the calling thread only
+    Sequential,
+    // rows shared among the OpenMP threads of the caller
+    OpenMP,
+    // the current CUDA device, float kernels only
+    CUDA
+};
+
+// the flags of the Sobel and Canny executables, see parseSobelArgs and
+// parseCannyArgs. Only the half for the chosen algorithm is read
+struct EdgeParams {
+    SobelConfig sobel;
+    CannyConfig canny;
+};
+
+// size of the edge image for an input of width x height. Canny edges shrink
+// with params.canny.gaussian_size
+int edgeOutputWidth(EdgeAlgorithm algorithm, int width, const EdgeParams& params);
+int edgeOutputHeight(EdgeAlgorithm algorithm, int height, const EdgeParams& params);
+
+// Writes the edges of a grey image to `output`, which must be
+// edgeOutputWidth x edgeOutputHeight of the input. Views may have any
+// stride. Sobel writes the clamped magnitude and Canny writes edge_none or
+// edge_strong (0 or 255). uint8 input runs the integer kernels when the
+// params ask for them and is widened for the float ones. Float input holds
+// grey levels in [0, 255] and cannot run the integer kernels. Throws
+// std::runtime_error on a wrong output size, on Canny params that
+// cannyConfigError rejects, on a combination the backend does not support,
+// or when the backend fails.
+void detectEdges(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    EdgeAlgorithm algorithm, EdgeBackend backend, const EdgeParams& params);
+void detectEdges(ImageView<const float> input, ImageView<uint8_t> output,
+    EdgeAlgorithm algorithm, EdgeBackend backend, const EdgeParams& params);
+
+#endif
@@ -0,0 +1,159 @@
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include "frame_stream.h"
+#include "trace.h"
+
+namespace {
+
+// chroma planes after a luma plane of width x height for the Y4M colour space tag
+std::streamsize chromaBytes(const std::string& colour_space, int width, int height) {
+    std::streamsize half_width = (width + 1) / 2;
+    std::streamsize half_height = (height + 1) / 2;
+    if (colour_space == "mono") {
+        return 0;
+    }
+    if (colour_space.rfind("420", 0) == 0) {
+        return 2 * half_width * half_height;
+    }
+    if (colour_space == "422") {
+        return 2 * half_width * height;
+    }
+    if (colour_space == "444") {
+        return 2 * (std::streamsize)width * height;
+    }
+    if (colour_space == "444alpha") {
+        return 3 * (std::streamsize)width * height;
+    }
+    throw std::runtime_error("Unsupported Y4M colour space: " + colour_space);
+}
+
+}
+
+FrameReader::FrameReader(const std::string& path):
+    width(0), height(0), stream(&std::cin), chroma_bytes(0), header_read(false)
+{
+    if (path != "-") {
+        file.open(path, std::ios::binary);
+        stream = &file;
+    }
+    if (!*stream) {
+        throw std::runtime_error("Failed to read stream: " + path);
+    }
+
+    if (stream->peek() == 'P') {
+        format = FrameFormat::PGM;
+        if (!readPgmHeader()) {
+            throw std::runtime_error("Failed to read stream: " + path);
+        }
+        return;
+    }
+
+    format = FrameFormat::Y4M;
+    std::string header;
+    std::getline(*stream, header);
+    std::istringstream tags(header);
+    std::string tag;
+    tags >> tag;
+    if (tag != "YUV4MPEG2") {
+        throw std::runtime_error("Failed to read stream: " + path);
+    }
+    // 420 when the stream does not say
+    std::string colour_space = "420";
+    while (tags >> tag) {
+        switch (tag[0]) {
+            case 'W': width = atoi(tag.c_str() + 1); break;
+            case 'H': height = atoi(tag.c_str() + 1); break;
+            case 'F': frame_rate = tag.substr(1); break;
+            case 'C': colour_space = tag.substr(1); break;
+            default: break;
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        throw std::runtime_error("Failed to read stream: " + path);
+    }
+    chroma_bytes = chromaBytes(colour_space, width, height);
+}
+
+bool FrameReader::readPgmHeader() {
+    std::string magic;
+    int max_value = 0;
+    // whitespace before the next image is skipped as well
+    if (!(*stream >> magic)) { return false; }
+    *stream >> width >> height >> max_value;
+    if (!*stream || magic != "P5" || max_value != 255 || width <= 0 || height <= 0) {
+        throw std::runtime_error("Failed to read PGM frame header");
+    }
+    // exactly one whitespace character separates the header from the pixels
+    stream->get();
+    header_read = true;
+    return true;
+}
+
+bool FrameReader::readFrame(ImageBuffer<uint8_t>* frame) {
+    if (format == FrameFormat::PGM) {
+        if (!header_read && !readPgmHeader()) { return false; }
+        header_read = false;
+    } else {
+        std::string frame_header;
+        if (!std::getline(*stream, frame_header)) { return false; }
+        if (frame_header.rfind("FRAME", 0) != 0) {
+            throw std::runtime_error("Failed to read Y4M frame header");
+        }
+    }
+
+    TRACE_SCOPE("readFrame");
+    if (frame->width != width || frame->height != height) {
+        *frame = ImageBuffer<uint8_t>(width, height);
+    }
+    for (int y = 0; y < height; ++y) {
+        stream->read(reinterpret_cast<char*>((*frame)[y]), width);
+    }
+    stream->ignore(chroma_bytes);
+    if (!*stream) {
+        throw std::runtime_error("Stream ended inside a frame");
+    }
+    return true;
+}
+
+FrameWriter::FrameWriter(const std::string& path, FrameFormat format,
+    const std::string& frame_rate
+):
+    format(format), frame_rate(frame_rate), stream(&std::cout), width(0), height(0)
+{
+    if (path != "-") {
+        file.open(path, std::ios::binary);
+        stream = &file;
+    }
+    if (!*stream) {
+        throw std::runtime_error("Failed to save stream: " + path);
+    }
+}
+
+void FrameWriter::writeFrame(ImageView<const uint8_t> frame) {
+    TRACE_SCOPE("writeFrame");
+    if (format == FrameFormat::PGM) {
+        *stream << "P5\n" << frame.width << " " << frame.height << "\n255\n";
+    } else {
+        if (width == 0) {
+            width = frame.width;
+            height = frame.height;
+            *stream << "YUV4MPEG2 W" << width << " H" << height;
+            if (!frame_rate.empty()) {
+                *stream << " F" << frame_rate;
+            }
+            *stream << " Ip A1:1 Cmono\n";
+        }
+        if (frame.width != width || frame.height != height) {
+            throw std::runtime_error("Y4M frames must all have the same size");
+        }
+        *stream << "FRAME\n";
+    }
+    for (int y = 0; y < frame.height; ++y) {
+        stream->write(reinterpret_cast<const char*>(frame[y]), frame.width);
+    }
+    stream->flush();
+    if (!*stream) {
+        throw std::runtime_error("Failed to save frame");
+    }
+}
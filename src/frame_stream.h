@@ -0,0 +1,64 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "image_buffer.h"
+
+enum class FrameFormat {
+    // YUV4MPEG2, only the luma plane is kept
+    Y4M,
+    // binary 8 bit PGM (P5) images back to back
+    PGM
+};
+
+// Grey frames from a Y4M or PGM stream, told apart by its first bytes. Reads
+// a file or, with path "-", stdin. Throws std::runtime_error on a malformed
+// stream or a Y4M colour space other than 8 bit mono, 420, 422 or 444
+struct FrameReader {
+    FrameFormat format;
+    // size of the next frame, known once the constructor returns
+    int width, height;
+    // Y4M frame rate tag like "30:1", passed on to the output
+    std::string frame_rate;
+
+    explicit FrameReader(const std::string& path);
+
+    // Reads the next frame into `frame`, which is only reallocated when the
+    // frame size changes. Blocks until the whole frame has arrived, false at
+    // the end of the stream
+    bool readFrame(ImageBuffer<uint8_t>* frame);
+
+private:
+    std::ifstream file;
+    std::istream* stream;
+    // chroma bytes after each Y4M luma plane, skipped
+    std::streamsize chroma_bytes;
+    // a PGM header was read but not its pixels yet
+    bool header_read;
+
+    bool readPgmHeader();
+};
+
+// Writes edge frames in the container the input came in, Y4M frames as
+// mono. Writes a file or, with path "-", stdout. Every frame is flushed, so
+// a reader downstream sees it right away
+struct FrameWriter {
+    FrameFormat format;
+    std::string frame_rate;
+
+    FrameWriter(const std::string& path, FrameFormat format, const std::string& frame_rate);
+
+    // Throws std::runtime_error if the frame cannot be written, or if a Y4M
+    // frame is not the size of the first one
+    void writeFrame(ImageView<const uint8_t> frame);
+
+private:
+    std::ofstream file;
+    std::ostream* stream;
+    // Y4M stream header written, with the size of the first frame
+    int width, height;
+};
+
+#endif
@@ -1,11 +1,13 @@
 #include <filesystem>
+#include <cstring>
 #include <opencv4/opencv2/opencv.hpp>
 #include "gray_image.h"
+#include "trace.h"
 
 namespace fs = std::filesystem;
 
-GrayImage::GrayImage(std::string input_dir, std::string file_name):
-    image(nullptr), width(0), height(0), file_name(file_name)
+GrayImage::GrayImage(std::string input_dir, std::string file_name, PixelFormat format):
+    format(format), width(0), height(0), file_name(file_name)
 {
     std::string input_path = input_dir + "/" + file_name;
     cv::Mat color_image = cv::imread(input_path, cv::IMREAD_COLOR);
@@ -18,25 +20,40 @@ GrayImage::GrayImage(std::string input_dir, std::string file_name):
 
     width = gray_image.cols;
     height = gray_image.rows;
-    image = new float*[height];
-    for (int y = 0; y < height; ++y) {
-        image[y] = new float[width];
-        for (int x = 0; x < width; ++x) {
-            image[y][x] = (float)gray_image.at<uint8_t>(y, x);
+    if (format == PixelFormat::UInt8) {
+        pixels = ImageBuffer<uint8_t>(width, height);
+        for (int y = 0; y < height; ++y) {
+            memcpy(pixels[y], gray_image.ptr<uint8_t>(y), width);
         }
+        return;
     }
+
+    image = widenPixels(ImageView<const uint8_t>(gray_image.ptr<uint8_t>(0), width, height,
+        (int)gray_image.step), false);
 }
 
-GrayImage::~GrayImage() {
-    if (!image) { return; }
+GrayImage::GrayImage(const ImageSource& source, PixelFormat format):
+    format(format), width(0), height(0), file_name(source.file_name)
+{
+    TRACE_SCOPE("loadImage");
+    if (!source.cached_pixels.data) {
+        *this = GrayImage(source.directory, source.file_name, format);
+        return;
+    }
 
-    for (int i = 0; i < height; ++i) {
-        delete[] image[i];
+    ImageView<const uint8_t> cached = source.cached_pixels;
+    width = cached.width;
+    height = cached.height;
+    if (format == PixelFormat::UInt8) {
+        borrowed_pixels = cached;
+        return;
     }
-    delete[] image;
+
+    image = widenPixels(cached, false);
 }
 
 void GrayImage::saveImage(std::string output_dir) {
+    TRACE_SCOPE("saveImage");
     auto prefix = file_name.substr(0, file_name.find_last_of("."));
     auto suffix = file_name.substr(file_name.find_last_of("."));
     auto output_path = output_dir + "/" + prefix + "_output" + suffix;
@@ -47,8 +64,15 @@ void GrayImage::saveImage(std::string output_dir) {
 
     cv::Mat gray_image(height, width, CV_8UC1);
     for (int y = 0; y < height; ++y) {
+        uint8_t* dest = gray_image.ptr<uint8_t>(y);
+        if (format == PixelFormat::UInt8) {
+            memcpy(dest, pixelView()[y], width);
+            continue;
+        }
+
+        const float* src = image[y];
         for (int x = 0; x < width; ++x) {
-            gray_image.at<uint8_t>(y, x) = (uint8_t)image[y][x];
+            dest[x] = (uint8_t)src[x];
         }
     }
 
@@ -57,11 +81,11 @@ void GrayImage::saveImage(std::string output_dir) {
     }
 }
 
-std::vector<GrayImage*> getInputImages(const std::string& directory, bool verbose) {
-    std::vector<GrayImage*> images;
+std::vector<ImageSource> listInputImages(const std::string& directory) {
+    std::vector<ImageSource> sources;
     if (!fs::exists(directory) || !fs::is_directory(directory)) {
         std::cerr << "Directory [" << directory << "] does not exist" << std::endl;
-        return images;
+        return sources;
     }
 
     for (auto& entry : fs::directory_iterator(directory)) {
@@ -71,34 +95,49 @@ std::vector<GrayImage*> getInputImages(const std::string& directory, bool verbos
             if (suffix != "jpg" && suffix != "jpeg" && suffix != "png") {
                 continue;
             }
-
-            try {
-                GrayImage* new_image = new GrayImage(directory, file_name);
-                if (verbose) {
-                    std::cout << "Loaded image [" << file_name << "] successfully, dimension: "
-                        << new_image->width << "x" << new_image->height << std::endl;
-                }
-                images.emplace_back(new_image);
-            } catch (std::runtime_error& e) {
-                std::cerr << e.what() << std::endl;
-                std::cerr << "Failed to load image [" << file_name << "], skip" << std::endl;
-            }
+            sources.push_back({directory, file_name});
         }
     }
 
-    return images;
+    return sources;
 }
 
-std::vector<GrayImage*> getBSDS500Images(bool verbose) {
+std::vector<ImageSource> listBSDS500Images() {
     std::string image_path = "../inputs_BSDS500/BSDS500/data/images/";
-    auto test = getInputImages(image_path + "test", verbose);
-    auto train = getInputImages(image_path + "train", verbose);
-    auto val = getInputImages(image_path + "val", verbose);
+    std::vector<ImageSource> sources;
+    for (auto split : {"test", "train", "val"}) {
+        auto split_sources = listInputImages(image_path + split);
+        sources.insert(sources.end(), split_sources.begin(), split_sources.end());
+    }
+    return sources;
+}
 
+std::vector<GrayImage*> loadImages(const std::vector<ImageSource>& sources,
+    bool verbose, PixelFormat format
+) {
     std::vector<GrayImage*> images;
-    images.insert(images.end(), test.begin(), test.end());
-    images.insert(images.end(), train.begin(), train.end());
-    images.insert(images.end(), val.begin(), val.end());
-
+    for (auto& source : sources) {
+        try {
+            GrayImage* new_image = new GrayImage(source, format);
+            if (verbose) {
+                std::cout << "Loaded image [" << source.file_name << "] successfully, dimension: "
+                    << new_image->width << "x" << new_image->height << std::endl;
+            }
+            images.emplace_back(new_image);
+        } catch (std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            std::cerr << "Failed to load image [" << source.file_name << "], skip" << std::endl;
+        }
+    }
     return images;
 }
+
+std::vector<GrayImage*> getInputImages(const std::string& directory, bool verbose,
+    PixelFormat format
+) {
+    return loadImages(listInputImages(directory), verbose, format);
+}
+
+std::vector<GrayImage*> getBSDS500Images(bool verbose, PixelFormat format) {
+    return loadImages(listBSDS500Images(), verbose, format);
+}
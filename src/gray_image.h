@@ -3,22 +3,93 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include "image_buffer.h"
+
+enum class PixelFormat {
+    // pixels widened to float in `image`
+    Float32,
+    // pixels kept as loaded in `pixels`, for the integer pipelines
+    UInt8
+};
+
+// an image file that has not been decoded yet, or an image in a memory-mapped
+// cache when cached_pixels is set (see image_cache.h)
+struct ImageSource {
+    std::string directory;
+    std::string file_name;
+    ImageView<const uint8_t> cached_pixels;
+};
 
 struct GrayImage {
-    float** image;
+    ImageBuffer<float> image;
+    ImageBuffer<uint8_t> pixels;
+    // uint8 pixels owned by someone else, read instead of `pixels` until a
+    // stage assigns new storage. The owner must outlive the image
+    ImageView<const uint8_t> borrowed_pixels;
+    PixelFormat format;
     int width, height;
     std::string file_name;
 
-    GrayImage(std::string input_dir, std::string file_name);
-    ~GrayImage();
+    GrayImage(std::string input_dir, std::string file_name,
+        PixelFormat format = PixelFormat::Float32);
+
+    // decodes the file, or takes the cached pixels: UInt8 images borrow them
+    // without a copy, Float32 images widen them
+    GrayImage(const ImageSource& source, PixelFormat format = PixelFormat::Float32);
+
+    // the stages may shrink an image in place, so width/height can be smaller
+    // than the dimensions the buffer was allocated with
+    ImageView<float> view() const {
+        return ImageView<float>(image.data, width, height, image.stride);
+    }
+
+    ImageView<const uint8_t> pixelView() const {
+        if (borrowed_pixels.data) {
+            return ImageView<const uint8_t>(
+                borrowed_pixels.data, width, height, borrowed_pixels.stride);
+        }
+        return ImageView<const uint8_t>(pixels.data, width, height, pixels.stride);
+    }
+
+    // replace pixel storage with the output of a stage
+    void assign(ImageBuffer<float>&& new_image) {
+        width = new_image.width;
+        height = new_image.height;
+        image = std::move(new_image);
+        pixels = ImageBuffer<uint8_t>();
+        borrowed_pixels = ImageView<const uint8_t>();
+        format = PixelFormat::Float32;
+    }
+
+    void assign(ImageBuffer<uint8_t>&& new_pixels) {
+        width = new_pixels.width;
+        height = new_pixels.height;
+        pixels = std::move(new_pixels);
+        borrowed_pixels = ImageView<const uint8_t>();
+        image = ImageBuffer<float>();
+        format = PixelFormat::UInt8;
+    }
 
     void saveImage(std::string output_dir);
 };
 
+// jpg/jpeg/png files in `directory`, without decoding them
+std::vector<ImageSource> listInputImages(const std::string& directory);
+
+// test, train and val splits of BSDS500, in that order
+std::vector<ImageSource> listBSDS500Images();
+
+// require user to free memory. Sources that fail to load are reported and skipped
+std::vector<GrayImage*> loadImages(const std::vector<ImageSource>& sources,
+    bool verbose, PixelFormat format = PixelFormat::Float32);
+
 // require user to free memory
-std::vector<GrayImage*> getInputImages(const std::string& directory, bool verbose);
+std::vector<GrayImage*> getInputImages(const std::string& directory, bool verbose,
+    PixelFormat format = PixelFormat::Float32);
 
 // require user to free memory
-std::vector<GrayImage*> getBSDS500Images(bool verbose);
+std::vector<GrayImage*> getBSDS500Images(bool verbose,
+    PixelFormat format = PixelFormat::Float32);
 
 #endif
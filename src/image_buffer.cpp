@@ -0,0 +1,18 @@
+#include "image_buffer.h"
+
+void widenPixels(ImageView<const uint8_t> pixels, ImageView<float> image, bool parallel) {
+    #pragma omp parallel for if (parallel)
+    for (int y = 0; y < pixels.height; ++y) {
+        const uint8_t* src = pixels[y];
+        float* dest = image[y];
+        for (int x = 0; x < pixels.width; ++x) {
+            dest[x] = (float)src[x];
+        }
+    }
+}
+
+ImageBuffer<float> widenPixels(ImageView<const uint8_t> pixels, bool parallel) {
+    ImageBuffer<float> image(pixels.width, pixels.height);
+    widenPixels(pixels, image.view(), parallel);
+    return image;
+}
@@ -0,0 +1,107 @@
+#ifndef IMAGE_BUFFER_H
+#define IMAGE_BUFFER_H
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "buffer_pool.h"
+
+// every row starts on a cache line boundary, which is also the widest SIMD load
+const size_t image_alignment = 64;
+
+// number of elements per row after padding the row up to image_alignment bytes
+inline int alignedStride(int width, size_t element_size) {
+    int per_line = (int)(image_alignment / element_size);
+    return (width + per_line - 1) / per_line * per_line;
+}
+
+// Non-owning view of a 2D image. Rows are `stride` elements apart, so a view
+// can also describe a region of interest inside a larger image.
+template <typename T>
+struct ImageView {
+    T* data;
+    int width, height;
+    int stride;
+
+    ImageView(): data(nullptr), width(0), height(0), stride(0) {}
+    ImageView(T* data, int width, int height, int stride):
+        data(data), width(width), height(height), stride(stride) {}
+
+    T* operator[](int y) const {
+        return data + (size_t)y * stride;
+    }
+
+    ImageView<T> roi(int x, int y, int roi_width, int roi_height) const {
+        return ImageView<T>((*this)[y] + x, roi_width, roi_height, stride);
+    }
+
+    operator ImageView<const T>() const {
+        return ImageView<const T>(data, width, height, stride);
+    }
+};
+
+// Owning image storage: one contiguous allocation, aligned to image_alignment,
+// with each row padded so that every row is aligned as well. Blocks come from
+// and go back to the buffer pool, so stages can allocate their outputs freely.
+template <typename T>
+struct ImageBuffer {
+    T* data;
+    int width, height;
+    int stride;
+
+    ImageBuffer(): data(nullptr), width(0), height(0), stride(0) {}
+
+    ImageBuffer(int width, int height):
+        data(nullptr), width(width), height(height),
+        stride(alignedStride(width, sizeof(T)))
+    {
+        if (size() == 0) { return; }
+        data = static_cast<T*>(poolAllocate(size() * sizeof(T)));
+    }
+
+    ~ImageBuffer() {
+        poolRelease(data, size() * sizeof(T));
+    }
+
+    ImageBuffer(const ImageBuffer&) = delete;
+    ImageBuffer& operator=(const ImageBuffer&) = delete;
+
+    ImageBuffer(ImageBuffer&& other) noexcept:
+        data(other.data), width(other.width), height(other.height), stride(other.stride)
+    {
+        other.data = nullptr;
+        other.width = other.height = other.stride = 0;
+    }
+
+    ImageBuffer& operator=(ImageBuffer&& other) noexcept {
+        std::swap(data, other.data);
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(stride, other.stride);
+        return *this;
+    }
+
+    // number of elements including row padding
+    size_t size() const {
+        return (size_t)stride * height;
+    }
+
+    T* operator[](int y) const {
+        return data + (size_t)y * stride;
+    }
+
+    ImageView<T> view() const {
+        return ImageView<T>(data, width, height, stride);
+    }
+
+    ImageView<T> roi(int x, int y, int roi_width, int roi_height) const {
+        return view().roi(x, y, roi_width, roi_height);
+    }
+};
+
+// Grey levels to float for the float kernels, into `image`, which is the size
+// of `pixels`, or into a new buffer. With `parallel`, rows are shared among
+// the OpenMP threads of the caller
+void widenPixels(ImageView<const uint8_t> pixels, ImageView<float> image, bool parallel);
+ImageBuffer<float> widenPixels(ImageView<const uint8_t> pixels, bool parallel);
+
+#endif
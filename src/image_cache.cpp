@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image_cache.h"
+
+namespace fs = std::filesystem;
+
+ImageCache::ImageCache(const std::string& path): data(nullptr), size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open image cache: " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(ImageCacheHeader)) {
+        close(fd);
+        throw std::runtime_error("Image cache is truncated: " + path);
+    }
+    size = file_stat.st_size;
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        size = 0;
+        throw std::runtime_error("Failed to map image cache: " + path);
+    }
+    data = static_cast<const uint8_t*>(mapping);
+
+    // the destructor does not run when the constructor throws. A cache that
+    // does not pass is rebuilt by deleting it
+    auto invalid = [&](const std::string& reason) {
+        munmap(mapping, size);
+        data = nullptr;
+        size = 0;
+        return std::runtime_error("Not a valid image cache (" + reason + "), delete it to "
+            "rebuild: " + path);
+    };
+
+    // every offset and length below comes from the file, so each is checked
+    // against what is left of the mapping before it is added to anything
+    ImageCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, image_cache_magic, sizeof(header.magic)) != 0 ||
+        header.version != image_cache_version
+    ) {
+        throw invalid("wrong magic or version");
+    }
+    if (header.index_offset > size || header.index_offset % alignof(ImageCacheEntry) != 0 ||
+        header.image_count > (size - header.index_offset) / sizeof(ImageCacheEntry) ||
+        header.names_offset > size
+    ) {
+        throw invalid("index out of bounds");
+    }
+
+    const ImageCacheEntry* entries =
+        reinterpret_cast<const ImageCacheEntry*>(data + header.index_offset);
+    size_t names_size = size - header.names_offset;
+    images.reserve(header.image_count);
+    for (uint32_t i = 0; i < header.image_count; ++i) {
+        const ImageCacheEntry& entry = entries[i];
+        std::string what = "image " + std::to_string(i);
+        if (entry.width == 0 || entry.height == 0 || entry.stride < entry.width ||
+            entry.stride > (uint32_t)std::numeric_limits<int>::max() ||
+            entry.height > (uint32_t)std::numeric_limits<int>::max()
+        ) {
+            throw invalid(what + " has a bad size");
+        }
+        if (entry.offset > size || entry.offset % image_alignment != 0 ||
+            (uint64_t)entry.stride * entry.height > size - entry.offset
+        ) {
+            throw invalid(what + " has pixels out of bounds");
+        }
+        if (entry.name_offset > names_size || entry.name_length > names_size - entry.name_offset) {
+            throw invalid(what + " has a name out of bounds");
+        }
+
+        ImageSource source;
+        source.directory = path;
+        source.file_name.assign(reinterpret_cast<const char*>(
+            data + header.names_offset + entry.name_offset), entry.name_length);
+        source.cached_pixels = ImageView<const uint8_t>(
+            data + entry.offset, entry.width, entry.height, entry.stride);
+        images.push_back(std::move(source));
+    }
+}
+
+ImageCache::~ImageCache() {
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+ImageCache::ImageCache(ImageCache&& other) noexcept:
+    data(other.data), size(other.size), images(std::move(other.images))
+{
+    other.data = nullptr;
+    other.size = 0;
+}
+
+ImageCache& ImageCache::operator=(ImageCache&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(images, other.images);
+    return *this;
+}
+
+void writeImageCache(const std::vector<ImageSource>& sources, const std::string& path,
+    bool verbose
+) {
+    std::string temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Failed to create image cache: " + temp_path);
+    }
+
+    // the header is rewritten once the offsets are known
+    ImageCacheHeader header = {};
+    memcpy(header.magic, image_cache_magic, sizeof(header.magic));
+    header.version = image_cache_version;
+    fwrite(&header, sizeof(header), 1, file);
+
+    std::vector<ImageCacheEntry> entries;
+    std::string names;
+    const char padding[image_alignment] = {};
+    uint64_t offset = sizeof(header);
+    for (auto& source : sources) {
+        GrayImage* image = nullptr;
+        try {
+            image = new GrayImage(source, PixelFormat::UInt8);
+        } catch (std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            std::cerr << "Failed to load image [" << source.file_name << "], skip" << std::endl;
+            continue;
+        }
+
+        size_t pad = (image_alignment - offset % image_alignment) % image_alignment;
+        fwrite(padding, 1, pad, file);
+        offset += pad;
+
+        ImageView<const uint8_t> pixels = image->pixelView();
+        ImageCacheEntry entry = {};
+        entry.offset = offset;
+        entry.width = pixels.width;
+        entry.height = pixels.height;
+        entry.stride = alignedStride(pixels.width, 1);
+        entry.name_offset = names.size();
+        entry.name_length = source.file_name.size();
+        for (int y = 0; y < pixels.height; ++y) {
+            fwrite(pixels[y], 1, pixels.width, file);
+            fwrite(padding, 1, entry.stride - pixels.width, file);
+        }
+        offset += (uint64_t)entry.stride * entry.height;
+        entries.push_back(entry);
+        names += source.file_name;
+
+        if (verbose) {
+            std::cout << "Cached image [" << source.file_name << "], dimension: "
+                << pixels.width << "x" << pixels.height << std::endl;
+        }
+        delete image;
+    }
+
+    header.image_count = entries.size();
+    header.index_offset = offset;
+    header.names_offset = offset + entries.size() * sizeof(ImageCacheEntry);
+    fwrite(entries.data(), sizeof(ImageCacheEntry), entries.size(), file);
+    fwrite(names.data(), 1, names.size(), file);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    bool failed = ferror(file) != 0;
+    failed |= fclose(file) != 0;
+    if (failed) {
+        fs::remove(temp_path);
+        throw std::runtime_error("Failed to write image cache: " + temp_path);
+    }
+    fs::rename(temp_path, path);
+}
+
+std::string parseImageCacheArg(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg.rfind("--cache=", 0) == 0) {
+            return arg.substr(8);
+        }
+    }
+    return "";
+}
+
+std::vector<ImageSource> listDatasetImages(const std::string& cache_path,
+    ImageCache* cache, bool verbose
+) {
+    if (cache_path.empty()) {
+        return listBSDS500Images();
+    }
+
+    if (!fs::exists(cache_path)) {
+        std::cout << "Building image cache [" << cache_path << "]..." << std::endl;
+        writeImageCache(listBSDS500Images(), cache_path, verbose);
+    }
+    *cache = ImageCache(cache_path);
+    return cache->images;
+}
@@ -0,0 +1,70 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gray_image.h"
+
+// A dataset converted once into a single file of grayscale uint8 pixels, so
+// runs map it instead of decoding JPEGs. Layout, all integers native-endian:
+//
+//   ImageCacheHeader
+//   pixels of every image, each image starting on an image_alignment
+//     boundary with rows padded to alignedStride(width, 1)
+//   ImageCacheEntry[image_count] at header.index_offset
+//   file names, back to back, at header.names_offset
+//
+// Rows in the file are laid out exactly like an ImageBuffer<uint8_t>, so a
+// mapped image is handed out as an ImageView without copying.
+
+const char image_cache_magic[8] = {'E', 'D', 'G', 'E', 'C', 'A', 'C', 'H'};
+const uint32_t image_cache_version = 1;
+
+struct ImageCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t image_count;
+    uint64_t index_offset;
+    uint64_t names_offset;
+};
+
+struct ImageCacheEntry {
+    uint64_t offset;
+    uint32_t width, height, stride;
+    uint32_t name_offset, name_length;
+    uint32_t reserved;
+};
+
+// Read-only mapping of a cache file. Views stay valid while the cache lives.
+struct ImageCache {
+    const uint8_t* data;
+    size_t size;
+    std::vector<ImageSource> images;
+
+    ImageCache(): data(nullptr), size(0) {}
+    // throws std::runtime_error if the file is missing or malformed
+    explicit ImageCache(const std::string& path);
+    ~ImageCache();
+
+    ImageCache(const ImageCache&) = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
+    ImageCache(ImageCache&& other) noexcept;
+    ImageCache& operator=(ImageCache&& other) noexcept;
+};
+
+// Decodes `sources` and writes them to `path`. The file is written under a
+// temporary name and renamed at the end, so a reader never maps a partial
+// cache. Sources that fail to decode are reported and skipped.
+void writeImageCache(const std::vector<ImageSource>& sources, const std::string& path,
+    bool verbose);
+
+// reads --cache=<file>, empty if not given
+std::string parseImageCacheArg(int argc, char** argv);
+
+// The BSDS500 images, as files when cache_path is empty and otherwise as views
+// into `cache`, which maps cache_path after building it from the files if it
+// does not exist yet
+std::vector<ImageSource> listDatasetImages(const std::string& cache_path,
+    ImageCache* cache, bool verbose);
+
+#endif
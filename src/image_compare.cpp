@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include "image_compare.h"
+
+ImageComparison compareImages(ImageView<const uint8_t> reference,
+    ImageView<const uint8_t> output
+) {
+    ImageComparison comparison;
+    if (reference.width != output.width || reference.height != output.height) {
+        return comparison;
+    }
+    comparison.same_size = true;
+
+    double squared_error = 0.0;
+    long long both_edges = 0;
+    long long reference_edges = 0;
+    long long output_edges = 0;
+    for (int y = 0; y < reference.height; ++y) {
+        const uint8_t* reference_row = reference[y];
+        const uint8_t* output_row = output[y];
+        for (int x = 0; x < reference.width; ++x) {
+            int difference = std::abs(reference_row[x] - output_row[x]);
+            if (difference) {
+                ++comparison.differing_pixels;
+                comparison.max_difference = std::max(comparison.max_difference, difference);
+                squared_error += (double)difference * difference;
+            }
+            bool reference_edge = reference_row[x] != 0;
+            bool output_edge = output_row[x] != 0;
+            reference_edges += reference_edge;
+            output_edges += output_edge;
+            both_edges += reference_edge && output_edge;
+        }
+    }
+
+    double pixels = (double)reference.width * reference.height;
+    comparison.psnr = squared_error == 0.0 ? std::numeric_limits<double>::infinity() :
+        10.0 * std::log10(255.0 * 255.0 / (squared_error / pixels));
+    // two images without an edge agree completely
+    comparison.f_score = reference_edges + output_edges == 0 ? 1.0 :
+        2.0 * both_edges / (double)(reference_edges + output_edges);
+    return comparison;
+}
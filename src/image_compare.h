@@ -0,0 +1,22 @@
+#ifndef IMAGE_COMPARE_H
+#define IMAGE_COMPARE_H
+#include <cstdint>
+#include "image_buffer.h"
+
+// How far an edge image is from a reference of the same size. Identical
+// images have no differing pixels, an infinite PSNR and an F-score of 1
+struct ImageComparison {
+    bool same_size = false;
+    long long differing_pixels = 0;
+    int max_difference = 0;
+    // peak signal to noise ratio in dB, for grey level outputs like Sobel's
+    double psnr = 0.0;
+    // Harmonic mean of precision and recall of the edge pixels (any non-zero
+    // pixel), for binary outputs like Canny's. Pixels must match exactly
+    double f_score = 0.0;
+};
+
+ImageComparison compareImages(ImageView<const uint8_t> reference,
+    ImageView<const uint8_t> output);
+
+#endif
@@ -1,35 +1,230 @@
-#include <iostream>
+#include <algorithm>
 #include <cstdlib>
+#include <iostream>
 #include <string>
+#include "benchmark.h"
+#include "image_cache.h"
+#include "pipeline.h"
+#include "trace.h"
+
+// Benchmarks every executable's backend. The sequential, OpenMP and CUDA
+// backends run in this process through libedgedetect, so decoding, computing
+// and saving every image are timed on their own. The MPI executables need
+// their own processes and are launched with mpirun once per repetition, and
+// the times they print are collected instead.
+
+struct BenchmarkConfig {
+    int warmup = 2;
+    int reps = 10;
+    std::vector<std::string> algorithms = {"sobel", "canny"};
+    std::vector<std::string> backends = {"seq", "omp", "mpi", "hybrid", "cuda"};
+    bool save = true;
+    // ranks of the MPI and hybrid runs, mpirun_args places them
+    int np = 6;
+    std::string mpirun_args;
+    std::string csv_path;
+    std::string json_path;
+    // arguments the benchmark does not know, passed on to the MPI executables
+    std::vector<std::string> forwarded;
+};
+
+BenchmarkConfig parseBenchmarkArgs(int argc, char** argv) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--reps=", 0) == 0) {
+            config.reps = std::max(1, atoi(arg.c_str() + 7));
+        } else if (arg.rfind("--warmup=", 0) == 0) {
+            config.warmup = std::max(0, atoi(arg.c_str() + 9));
+        } else if (arg.rfind("--algorithms=", 0) == 0) {
+            config.algorithms = splitList(arg.substr(13));
+        } else if (arg.rfind("--backends=", 0) == 0) {
+            config.backends = splitList(arg.substr(11));
+        } else if (arg == "--no-save") {
+            config.save = false;
+        } else if (arg.rfind("--np=", 0) == 0) {
+            config.np = std::max(1, atoi(arg.c_str() + 5));
+        } else if (arg.rfind("--mpirun-args=", 0) == 0) {
+            config.mpirun_args = arg.substr(14);
+        } else if (arg.rfind("--csv=", 0) == 0) {
+            config.csv_path = arg.substr(6);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            config.json_path = arg.substr(7);
+        } else if (arg != "-v" && arg != "--verbose" && arg.rfind("--trace=", 0) != 0) {
+            config.forwarded.push_back(arg);
+        }
+    }
+    return config;
+}
+
+long long elapsedNs(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+    return chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+}
+
+// the output directories the executables of each backend write to
+std::string outputDirName(const std::string& backend) {
+    if (backend == "seq") { return "sequential"; }
+    if (backend == "omp") { return "openmp"; }
+    return backend;
+}
+
+// Decodes, computes and saves every image once per repetition. Images run one
+// after another, so the OpenMP backend shares the rows of one image among its
+// threads instead of running images side by side like sobel_omp and canny_omp
+void benchmarkInProcess(const std::string& algorithm_name, const std::string& backend_name,
+    const std::vector<ImageSource>& sources, const EdgeParams& params,
+    const BenchmarkConfig& config, BenchmarkReport* report
+) {
+    EdgeAlgorithm algorithm = algorithm_name == "sobel" ?
+        EdgeAlgorithm::Sobel : EdgeAlgorithm::Canny;
+    EdgeBackend backend = backend_name == "seq" ? EdgeBackend::Sequential :
+        backend_name == "omp" ? EdgeBackend::OpenMP : EdgeBackend::CUDA;
+    bool integer = algorithm == EdgeAlgorithm::Sobel ? params.sobel.integer : params.canny.integer;
+    PixelFormat format = integer ? PixelFormat::UInt8 : PixelFormat::Float32;
+    std::string output_dir = "../" + algorithm_name + "_outputs/" + outputDirName(backend_name);
+
+    const int stage_count = 3;
+    const char* stages[stage_count] = {"decode", "compute", "save"};
+    // samples[stage][image] and totals[stage], one entry per measured repetition
+    std::vector<std::vector<long long>> samples[stage_count];
+    std::vector<long long> totals[stage_count];
+    for (int s = 0; s < stage_count; ++s) {
+        samples[s].resize(sources.size());
+    }
+
+    for (int rep = -config.warmup; rep < config.reps; ++rep) {
+        long long rep_totals[stage_count] = {};
+        for (size_t i = 0; i < sources.size(); ++i) {
+            auto decode_start = chrono::steady_clock::now();
+            std::vector<GrayImage*> loaded = loadImages({sources[i]}, false, format);
+            auto compute_start = chrono::steady_clock::now();
+            if (loaded.empty()) { continue; }
+
+            GrayImage* image = loaded[0];
+            detectEdges(image, algorithm, backend, params);
+            auto save_start = chrono::steady_clock::now();
+            if (config.save) {
+                image->saveImage(output_dir);
+            }
+            auto save_end = chrono::steady_clock::now();
+            delete image;
+
+            // warm-up repetitions fill caches and the buffer pool, they are not kept
+            if (rep < 0) { continue; }
+            long long times[stage_count] = {elapsedNs(decode_start, compute_start),
+                elapsedNs(compute_start, save_start), elapsedNs(save_start, save_end)};
+            for (int s = 0; s < stage_count; ++s) {
+                samples[s][i].push_back(times[s]);
+                rep_totals[s] += times[s];
+            }
+        }
+        if (rep < 0) { continue; }
+        for (int s = 0; s < stage_count; ++s) {
+            totals[s].push_back(rep_totals[s]);
+        }
+    }
 
-void executeCMD(std::string cmd, bool verbose) {
-    if (verbose) {
-        cmd += " -v";
+    int measured_stages = config.save ? stage_count : stage_count - 1;
+    for (int s = 0; s < measured_stages; ++s) {
+        report->add(algorithm_name, backend_name, "all", stages[s], totals[s]);
     }
+    for (size_t i = 0; i < sources.size(); ++i) {
+        for (int s = 0; s < measured_stages; ++s) {
+            report->add(algorithm_name, backend_name, sources[i].file_name, stages[s],
+                samples[s][i]);
+        }
+    }
+}
 
-    int result = system(cmd.c_str());
-    if (result != 0) {
-        std::cerr << "Execute [" << cmd 
-            << "] failed with error code " << result << std::endl;
+const int mpi_stage_count = 5;
+
+// The MPI executables only report whole runs, so every sample is one launch.
+// "total" is their Duration, decoding and saving included, and the wait
+// stages are the mean time a rank spent waiting in each phase
+void benchmarkLauncher(const std::string& algorithm_name, const std::string& backend_name,
+    const BenchmarkConfig& config, BenchmarkReport* report
+) {
+    std::string command = mpirunCommand("./" + algorithm_name + "_" + backend_name,
+        config.np, config.mpirun_args, config.forwarded);
+
+    const char* stages[mpi_stage_count] = {
+        "total", "wait_scatter", "wait_halo", "wait_gather", "wait_save"};
+    std::vector<long long> samples[mpi_stage_count];
+    for (int rep = -config.warmup; rep < config.reps; ++rep) {
+        MpiRunTimes times;
+        if (!runMpiCommand(command, &times) || times.duration < 0 || times.waits[0] < 0) {
+            std::cerr << "Execute [" << command << "] failed, skip" << std::endl;
+            return;
+        }
+        if (rep < 0) { continue; }
+        samples[0].push_back(times.duration);
+        for (int s = 1; s < mpi_stage_count; ++s) {
+            samples[s].push_back(times.waits[s - 1]);
+        }
+    }
+
+    for (int s = 0; s < mpi_stage_count; ++s) {
+        report->add(algorithm_name, backend_name, "all", stages[s], samples[s]);
     }
 }
 
 int main(int argc, char* argv[]) {
+    BenchmarkConfig config = parseBenchmarkArgs(argc, argv);
     bool verbose = false;
-    if (argc > 1) {
-        auto arg1 = std::string(argv[1]);
-        if (arg1 == "-v" || arg1 == "--verbose") {
-            verbose = true;
+    EdgeParams params;
+    params.sobel = parseSobelArgs(argc, argv, &verbose);
+    params.canny = parseCannyArgs(argc, argv, &verbose);
+    std::string cache_path = parseImageCacheArg(argc, argv);
+    // spans of the in-process backends, the MPI executables are not traced
+    std::string trace_path = parseTraceArg(argc, argv);
+
+    std::cout << "==========Benchmark==========" << std::endl;
+    std::cout << config.warmup << " warm-up and " << config.reps
+        << " measured runs per backend" << std::endl;
+    std::cout << "Loading images..." << std::endl;
+    ImageCache cache;
+    std::vector<ImageSource> sources = listDatasetImages(cache_path, &cache, false);
+
+    traceStart(0, "Benchmark");
+    BenchmarkReport report;
+    report.warmup = config.warmup;
+    report.reps = config.reps;
+    for (const auto& algorithm : config.algorithms) {
+        if (algorithm != "sobel" && algorithm != "canny") {
+            std::cerr << "Unknown algorithm [" << algorithm << "], skip" << std::endl;
+            continue;
         }
-    }
+        for (const auto& backend : config.backends) {
+            std::cout << "Benchmarking " << algorithm << " " << backend << "..." << std::endl;
+            if (backend == "mpi" || backend == "hybrid") {
+                benchmarkLauncher(algorithm, backend, config, &report);
+                continue;
+            }
+            if (backend != "seq" && backend != "omp" && backend != "cuda") {
+                std::cerr << "Unknown backend [" << backend << "], skip" << std::endl;
+                continue;
+            }
 
-    executeCMD("./sobel_seq", verbose);
-    executeCMD("./sobel_omp", verbose);
-    executeCMD("mpirun -np 6 ./sobel_mpi", verbose);
-    executeCMD("./sobel_cuda", verbose);
+            try {
+                benchmarkInProcess(algorithm, backend, sources, params, config, &report);
+            } catch (std::runtime_error& e) {
+                // a missing GPU, or an option the backend does not have
+                std::cerr << e.what() << std::endl;
+                std::cerr << "Benchmark of " << algorithm << " " << backend
+                    << " failed, skip" << std::endl;
+            }
+        }
+    }
 
-    executeCMD("./canny_seq", verbose);
-    executeCMD("./canny_omp", verbose);
-    executeCMD("mpirun -np 6 ./canny_mpi", verbose);
-    executeCMD("./canny_cuda", verbose);
+    report.print(verbose);
+    if (!config.csv_path.empty()) {
+        report.writeCSV(config.csv_path);
+    }
+    if (!config.json_path.empty()) {
+        report.writeJSON(config.json_path);
+    }
+    if (!trace_path.empty()) {
+        writeTrace(trace_path);
+    }
+    return 0;
 }
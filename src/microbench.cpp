@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <omp.h>
+#include <unistd.h>
+#include "benchmark.h"
+#include "edgedetect.h"
+#include "synthetic_image.h"
+#include "trace.h"
+#include "canny/canny_cpu.h"
+#include "canny/canny_fused.h"
+#include "sobel/sobel_batch.h"
+#include "sobel/sobel_cpu.h"
+
+// Times the kernels on generated images instead of the dataset, across a
+// sweep of sizes, patterns and OpenMP thread counts. Every time is reported
+// as pixels of the input per second and as bytes per second, where the bytes
+// are the buffers the stage reads plus the buffers it writes. While those
+// fit in a cache level the bytes/s stay flat, and they drop at the size where
+// a backend falls out of it.
+
+struct MicrobenchConfig {
+    int warmup = 1;
+    int reps = 5;
+    std::vector<std::string> algorithms = {"sobel", "canny"};
+    std::vector<std::string> backends = {"seq", "omp", "cuda"};
+    std::vector<SyntheticPattern> patterns = allSyntheticPatterns();
+    // width x height, from the dataset's size up to 8K
+    std::vector<std::pair<int, int>> sizes = {
+        {481, 321}, {1024, 768}, {1920, 1080}, {3840, 2160}, {7680, 4320}};
+    // thread counts of the OpenMP backend, 1, 2, 4 ... and every thread if empty
+    std::vector<int> threads;
+    // images per batch run of float Sobel on the CPU, 0 skips batch runs
+    int batch_images = 0;
+    std::string csv_path;
+};
+
+// one timed stage of one configuration
+struct MicrobenchRow {
+    std::string algorithm;
+    std::string backend;
+    std::string pattern;
+    int width;
+    int height;
+    // OpenMP threads, 1 for the sequential backend and 0 for CUDA
+    int threads;
+    std::string stage;
+    long long bytes;
+    StageStats stats;
+};
+
+// a stage's name, the bytes it reads and writes, and its measured times
+struct StageTimes {
+    const char* stage;
+    long long bytes;
+    std::vector<long long> samples;
+};
+
+using Clock = std::chrono::steady_clock;
+
+long long elapsedNs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+MicrobenchConfig parseMicrobenchArgs(int argc, char** argv) {
+    MicrobenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--reps=", 0) == 0) {
+            config.reps = std::max(1, atoi(arg.c_str() + 7));
+        } else if (arg.rfind("--warmup=", 0) == 0) {
+            config.warmup = std::max(0, atoi(arg.c_str() + 9));
+        } else if (arg.rfind("--algorithms=", 0) == 0) {
+            config.algorithms = splitList(arg.substr(13));
+        } else if (arg.rfind("--backends=", 0) == 0) {
+            config.backends = splitList(arg.substr(11));
+        } else if (arg.rfind("--patterns=", 0) == 0) {
+            config.patterns.clear();
+            for (const auto& name : splitList(arg.substr(11))) {
+                try {
+                    config.patterns.push_back(parseSyntheticPattern(name));
+                } catch (std::runtime_error& e) {
+                    std::cerr << "Unknown pattern [" << name << "], skip" << std::endl;
+                }
+            }
+        } else if (arg.rfind("--sizes=", 0) == 0) {
+            config.sizes.clear();
+            for (const auto& size : splitList(arg.substr(8))) {
+                int width = 0;
+                int height = 0;
+                // whether a size leaves any edges depends on the algorithm
+                // and its params, which main checks
+                if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 ||
+                        width < 1 || height < 1) {
+                    std::cerr << "Invalid size [" << size << "], skip" << std::endl;
+                    continue;
+                }
+                config.sizes.push_back({width, height});
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            config.threads.clear();
+            for (const auto& count : splitList(arg.substr(10))) {
+                config.threads.push_back(std::max(1, atoi(count.c_str())));
+            }
+        } else if (arg.rfind("--batch-images=", 0) == 0) {
+            config.batch_images = std::max(0, atoi(arg.c_str() + 15));
+        } else if (arg.rfind("--csv=", 0) == 0) {
+            config.csv_path = arg.substr(6);
+        }
+    }
+
+    if (config.threads.empty()) {
+        int max_threads = omp_get_max_threads();
+        for (int count = 1; count < max_threads; count *= 2) {
+            config.threads.push_back(count);
+        }
+        config.threads.push_back(max_threads);
+    }
+    return config;
+}
+
+// The caches the working sets are compared against. glibc reads them from
+// the CPU, other C libraries may not know them
+void printCacheSizes() {
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    long sizes[3] = {sysconf(_SC_LEVEL1_DCACHE_SIZE), sysconf(_SC_LEVEL2_CACHE_SIZE),
+        sysconf(_SC_LEVEL3_CACHE_SIZE)};
+    const char* names[3] = {"L1d", "L2", "L3"};
+    std::cout << "Caches:";
+    for (int i = 0; i < 3; ++i) {
+        if (sizes[i] > 0) {
+            std::cout << " " << names[i] << " " << sizes[i] / 1024 << " KB";
+        }
+    }
+    std::cout << std::endl;
+#endif
+}
+
+// The whole detectEdges call. Its bytes are the input and the edge image,
+// whatever the backend keeps in between is not counted
+template <typename T>
+StageTimes timeDetectEdges(ImageView<const T> input, EdgeAlgorithm algorithm,
+    EdgeBackend backend, const EdgeParams& params, const MicrobenchConfig& config
+) {
+    ImageBuffer<uint8_t> edges(edgeOutputWidth(algorithm, input.width, params),
+        edgeOutputHeight(algorithm, input.height, params));
+    StageTimes times = {"total",
+        (long long)input.width * input.height * (long long)sizeof(T) +
+            (long long)edges.width * edges.height,
+        {}};
+    for (int rep = -config.warmup; rep < config.reps; ++rep) {
+        auto start = Clock::now();
+        detectEdges(input, edges.view(), algorithm, backend, params);
+        auto end = Clock::now();
+        if (rep >= 0) {
+            times.samples.push_back(elapsedNs(start, end));
+        }
+    }
+    return times;
+}
+
+// Every stage of the staged float Canny on its own, in the order cannyCPU
+// runs them
+std::vector<StageTimes> timeCannyStages(ImageView<const float> input,
+    const CannyConfig& canny, bool parallel, const MicrobenchConfig& config
+) {
+    long long input_pixels = (long long)input.width * input.height;
+    long long smoothed_pixels = (long long)getOutputWidth(input.width, canny.gaussian_size) *
+        getOutputHeight(input.height, canny.gaussian_size);
+    long long edge_pixels = (long long)getFusedOutputWidth(input.width, canny) *
+        getFusedOutputHeight(input.height, canny);
+    // float magnitudes and uint8 directions or edge classes
+    std::vector<StageTimes> stages = {
+        {"gaussianFilter", 4 * (input_pixels + smoothed_pixels), {}},
+        {"computeGradients", 4 * smoothed_pixels + 5 * edge_pixels, {}},
+        {"nonMaxSuppression", 5 * edge_pixels + 4 * edge_pixels, {}},
+        {"doubleThreshold", 4 * edge_pixels + edge_pixels, {}},
+        {"hysteresis", 2 * edge_pixels, {}},
+    };
+
+    for (int rep = -config.warmup; rep < config.reps; ++rep) {
+        Clock::time_point times[6];
+        times[0] = Clock::now();
+        ImageBuffer<float> smoothed = gaussianFilter(input, canny, parallel);
+        times[1] = Clock::now();
+        ImageBuffer<uint8_t> direction;
+        ImageBuffer<float> magnitude = computeGradients(smoothed.view(), &direction, canny,
+            parallel);
+        times[2] = Clock::now();
+        ImageBuffer<float> suppressed = nonMaxSuppression(magnitude.view(), direction.view(),
+            parallel);
+        ImageBuffer<uint8_t> edges(suppressed.width, suppressed.height);
+        times[3] = Clock::now();
+        doubleThreshold(suppressed.view(), edges.view(), canny, parallel);
+        times[4] = Clock::now();
+        hysteresis(edges.view(), parallel);
+        times[5] = Clock::now();
+
+        if (rep < 0) { continue; }
+        for (size_t s = 0; s < stages.size(); ++s) {
+            stages[s].samples.push_back(elapsedNs(times[s], times[s + 1]));
+        }
+    }
+    return stages;
+}
+
+// Float Sobel over config.batch_images different images of one size, one
+// image at a time (side by side across the threads, as sobel_omp runs them)
+// and in batches with either schedule. Times and bytes are per image, so the
+// rows compare with the single-image ones
+std::vector<StageTimes> timeSobelBatches(SyntheticPattern pattern, int width, int height,
+    SimdLevel simd, bool parallel, const MicrobenchConfig& config
+) {
+    int count = config.batch_images;
+    std::vector<ImageBuffer<float>> images;
+    std::vector<ImageBuffer<uint8_t>> edges;
+    std::vector<ImageView<const float>> inputs;
+    std::vector<ImageView<uint8_t>> outputs;
+    for (int i = 0; i < count; ++i) {
+        images.push_back(widenPixels(syntheticImage(pattern, width, height, i + 1).view(), false));
+        edges.emplace_back(getOutputWidth(width), getOutputHeight(height));
+        inputs.push_back(images.back().view());
+        outputs.push_back(edges.back().view());
+    }
+
+    long long bytes = 4LL * width * height + (long long)edges[0].width * edges[0].height;
+    std::vector<StageTimes> stages = {
+        {"perImage", bytes, {}},
+        {"batchNested", bytes, {}},
+        {"batchFlattened", bytes, {}},
+    };
+    SobelRowKernel row_kernel = getSobelRowKernel(simd);
+    for (int rep = -config.warmup; rep < config.reps; ++rep) {
+        Clock::time_point times[4];
+        times[0] = Clock::now();
+        #pragma omp parallel for schedule(dynamic) if (parallel)
+        for (int i = 0; i < count; ++i) {
+            sobelCPU(inputs[i], outputs[i], row_kernel, false);
+        }
+        times[1] = Clock::now();
+        sobelBatchCPU(inputs, outputs, simd, BatchSchedule::Nested, parallel);
+        times[2] = Clock::now();
+        sobelBatchCPU(inputs, outputs, simd, BatchSchedule::Flattened, parallel);
+        times[3] = Clock::now();
+
+        if (rep < 0) { continue; }
+        for (size_t s = 0; s < stages.size(); ++s) {
+            stages[s].samples.push_back(elapsedNs(times[s], times[s + 1]) / count);
+        }
+    }
+    return stages;
+}
+
+void printRow(const MicrobenchRow& row) {
+    double seconds = row.stats.median / 1e9;
+    double pixels = (double)row.width * row.height;
+    std::cout << "  " << std::setw(12) << std::left << row.pattern << std::right
+        << std::setw(6) << row.width << "x" << std::setw(5) << std::left << row.height
+        << std::right << " t" << std::setw(3) << std::left << row.threads << std::right
+        << " " << row.stage << ": median " << row.stats.median << " ns, "
+        << std::fixed << std::setprecision(1) << pixels / seconds / 1e6 << " Mpixel/s, "
+        << std::setprecision(2) << row.bytes / seconds / 1e9 << " GB/s ("
+        << std::setprecision(1) << row.bytes / 1e6 << " MB)" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+void writeCSV(const std::string& path, const std::vector<MicrobenchRow>& rows) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to write benchmark: " + path);
+    }
+    file << "algorithm,backend,pattern,width,height,threads,stage,samples,"
+        "min_ns,median_ns,p95_ns,bytes,pixels_per_s,bytes_per_s\n";
+    for (const auto& row : rows) {
+        double seconds = row.stats.median / 1e9;
+        file << row.algorithm << "," << row.backend << "," << row.pattern << ","
+            << row.width << "," << row.height << "," << row.threads << "," << row.stage << ","
+            << row.stats.samples << "," << row.stats.min << "," << row.stats.median << ","
+            << row.stats.p95 << "," << row.bytes << ","
+            << (long long)((double)row.width * row.height / seconds) << ","
+            << (long long)(row.bytes / seconds) << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    MicrobenchConfig config = parseMicrobenchArgs(argc, argv);
+    bool verbose = false;
+    EdgeParams params;
+    params.sobel = parseSobelArgs(argc, argv, &verbose);
+    params.canny = parseCannyArgs(argc, argv, &verbose);
+    std::string trace_path = parseTraceArg(argc, argv);
+
+    std::cout << "==========Kernel Microbenchmark==========" << std::endl;
+    std::cout << config.warmup << " warm-up and " << config.reps
+        << " measured runs per configuration" << std::endl;
+    printCacheSizes();
+
+    traceStart(0, "Kernel Microbenchmark");
+    std::vector<MicrobenchRow> rows;
+    // backends that failed once, e.g. without a GPU, are not tried again.
+    // Sizes too small for the kernels are left out before, so they do not
+    // count as a failure of the backend
+    std::set<std::string> failed;
+    for (const auto& algorithm_name : config.algorithms) {
+        if (algorithm_name != "sobel" && algorithm_name != "canny") {
+            std::cerr << "Unknown algorithm [" << algorithm_name << "], skip" << std::endl;
+            continue;
+        }
+        EdgeAlgorithm algorithm = algorithm_name == "sobel" ?
+            EdgeAlgorithm::Sobel : EdgeAlgorithm::Canny;
+        bool integer = algorithm == EdgeAlgorithm::Sobel ?
+            params.sobel.integer : params.canny.integer;
+        std::vector<std::pair<int, int>> sizes;
+        for (const auto& size : config.sizes) {
+            if (edgeOutputWidth(algorithm, size.first, params) <= 0 ||
+                    edgeOutputHeight(algorithm, size.second, params) <= 0) {
+                std::cerr << "Size " << size.first << "x" << size.second << " is too small for "
+                    << algorithm_name << ", skip" << std::endl;
+                continue;
+            }
+            sizes.push_back(size);
+        }
+
+        for (const auto& backend_name : config.backends) {
+            if (backend_name != "seq" && backend_name != "omp" && backend_name != "cuda") {
+                std::cerr << "Unknown backend [" << backend_name << "], skip" << std::endl;
+                continue;
+            }
+            EdgeBackend backend = backend_name == "seq" ? EdgeBackend::Sequential :
+                backend_name == "omp" ? EdgeBackend::OpenMP : EdgeBackend::CUDA;
+            std::vector<int> thread_counts = backend == EdgeBackend::OpenMP ?
+                config.threads : std::vector<int>{backend == EdgeBackend::CUDA ? 0 : 1};
+            // only the staged float path on the CPU can be taken apart
+            bool stages = algorithm == EdgeAlgorithm::Canny && !integer &&
+                params.canny.execution == CannyExecution::Staged &&
+                backend != EdgeBackend::CUDA;
+            bool batches = config.batch_images > 0 && algorithm == EdgeAlgorithm::Sobel &&
+                !integer && backend != EdgeBackend::CUDA;
+            std::cout << "----" << algorithm_name << " " << backend_name << "----" << std::endl;
+
+            for (SyntheticPattern pattern : config.patterns) {
+                for (const auto& size : sizes) {
+                    std::string key = algorithm_name + " " + backend_name;
+                    if (failed.count(key)) { break; }
+                    // the warm-up runs refill the pool for this size, blocks
+                    // of earlier sizes would only be kept until exit
+                    bufferPoolTrim();
+
+                    ImageBuffer<uint8_t> pixels = syntheticImage(pattern, size.first, size.second);
+                    ImageBuffer<float> image;
+                    if (!integer) {
+                        image = widenPixels(pixels.view(), false);
+                    }
+
+                    for (int threads : thread_counts) {
+                        if (backend == EdgeBackend::OpenMP) {
+                            omp_set_num_threads(threads);
+                        }
+                        std::vector<StageTimes> times;
+                        try {
+                            if (stages) {
+                                times = timeCannyStages(image.view(), params.canny,
+                                    backend == EdgeBackend::OpenMP, config);
+                            }
+                            times.push_back(integer ?
+                                timeDetectEdges<uint8_t>(pixels.view(), algorithm, backend,
+                                    params, config) :
+                                timeDetectEdges<float>(image.view(), algorithm, backend,
+                                    params, config));
+                            if (batches) {
+                                for (auto& stage : timeSobelBatches(pattern, size.first,
+                                        size.second, params.sobel.simd,
+                                        backend == EdgeBackend::OpenMP, config)) {
+                                    times.push_back(std::move(stage));
+                                }
+                            }
+                        } catch (std::runtime_error& e) {
+                            // a missing GPU, or an option the backend does not have
+                            std::cerr << e.what() << std::endl;
+                            std::cerr << "Benchmark of " << key << " failed, skip" << std::endl;
+                            failed.insert(key);
+                            break;
+                        }
+
+                        for (const auto& stage : times) {
+                            MicrobenchRow row = {algorithm_name, backend_name,
+                                syntheticPatternName(pattern), size.first, size.second,
+                                threads, stage.stage, stage.bytes, summarize(stage.samples)};
+                            printRow(row);
+                            rows.push_back(row);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (!config.csv_path.empty()) {
+        writeCSV(config.csv_path, rows);
+    }
+    if (!trace_path.empty()) {
+        writeTrace(trace_path);
+    }
+    return 0;
+}
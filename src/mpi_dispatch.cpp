@@ -0,0 +1,77 @@
+#include <iostream>
+#include <string>
+#include "mpi_dispatch.h"
+#include "trace.h"
+
+namespace {
+
+const int work_request_tag = 1;
+const int work_assign_tag = 2;
+// sent instead of an index once every image has been handed out
+const int no_more_work = -1;
+
+void dispatchImages(int image_count, int size, MPI_Comm comm) {
+    int next_index = 0;
+    int stopped = 0;
+    while (stopped < size - 1) {
+        int request;
+        MPI_Status status;
+        MPI_Recv(&request, 1, MPI_INT, MPI_ANY_SOURCE, work_request_tag, comm, &status);
+
+        int index = no_more_work;
+        if (next_index < image_count) {
+            index = next_index++;
+        } else {
+            ++stopped;
+        }
+        MPI_Send(&index, 1, MPI_INT, status.MPI_SOURCE, work_assign_tag, comm);
+    }
+}
+
+int requestImage(MPI_Comm comm) {
+    TRACE_SCOPE("requestImage");
+    int request = 0;
+    int index;
+    MPI_Send(&request, 1, MPI_INT, 0, work_request_tag, comm);
+    MPI_Recv(&index, 1, MPI_INT, 0, work_assign_tag, comm, MPI_STATUS_IGNORE);
+    return index;
+}
+
+}
+
+MpiDistribution parseMpiDistribution(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--distribute=images") {
+            return MpiDistribution::Images;
+        } else if (arg.rfind("--distribute=", 0) == 0 && arg != "--distribute=rows") {
+            std::cerr << "Unknown distribution [" << arg.substr(13)
+                << "], using rows" << std::endl;
+        }
+    }
+    return MpiDistribution::Rows;
+}
+
+int distributeImages(int image_count, MPI_Comm comm,
+    const std::function<void(int)>& process
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int processed = 0;
+    if (size == 1) {
+        for (int index = 0; index < image_count; ++index) {
+            process(index);
+            ++processed;
+        }
+    } else if (rank == 0) {
+        dispatchImages(image_count, size, comm);
+    } else {
+        for (int index = requestImage(comm); index != no_more_work; index = requestImage(comm)) {
+            process(index);
+            ++processed;
+        }
+    }
+    return processed;
+}
@@ -0,0 +1,25 @@
+#ifndef MPI_DISPATCH_H
+#define MPI_DISPATCH_H
+#include <functional>
+#include <mpi.h>
+
+// how the MPI executables share out the work
+enum class MpiDistribution {
+    // every rank computes a block of rows of every image
+    Rows,
+    // every rank computes whole images, handed out one at a time
+    Images,
+};
+
+// reads --distribute=rows|images, rows if not given
+MpiDistribution parseMpiDistribution(int argc, char** argv);
+
+// Runs process(index) once for every index in [0, image_count), each on one
+// rank of comm. Rank 0 only dispatches: the other ranks ask it for an index,
+// process that image and ask again, so a rank that gets small images or
+// finishes early simply takes more of them. With a single rank, rank 0
+// processes everything itself. Returns how many images this rank processed.
+int distributeImages(int image_count, MPI_Comm comm,
+    const std::function<void(int)>& process);
+
+#endif
@@ -0,0 +1,124 @@
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include "mpi_output.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+MpiOutput parseMpiOutput(int argc, char** argv) {
+    const std::string prefix = "--output=";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind(prefix, 0) != 0) { continue; }
+        std::string value = arg.substr(prefix.size());
+        if (value == "mpi-io") {
+            return MpiOutput::SharedFile;
+        }
+        if (value != "images") {
+            std::cerr << "Unknown output mode [" << value << "], using images" << std::endl;
+        }
+    }
+    return MpiOutput::Images;
+}
+
+std::string pgmOutputPath(const std::string& output_dir, const std::string& file_name) {
+    auto prefix = file_name.substr(0, file_name.find_last_of("."));
+    return output_dir + "/" + prefix + "_output.pgm";
+}
+
+void createOutputDirectory(const std::string& output_dir, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == 0 && !fs::exists(output_dir)) {
+        fs::create_directories(output_dir);
+    }
+    MPI_Barrier(comm);
+}
+
+void writeRowsPGM(const std::string& path, ImageView<const uint8_t> rows,
+    int width, int height, int start_y, MPI_Comm comm
+) {
+    TRACE_SCOPE("writeRowsPGM");
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    std::string header = "P5\n" + std::to_string(width) + " " +
+        std::to_string(height) + "\n255\n";
+    MPI_Offset header_size = header.size();
+
+    auto reportFailure = [&]() {
+        if (rank == 0) {
+            std::cerr << "Failed to save image: " << path << std::endl;
+        }
+    };
+
+    // opening is collective and fails on every rank together
+    MPI_File file;
+    int error = MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+        MPI_INFO_NULL, &file);
+    if (error != MPI_SUCCESS) {
+        reportFailure();
+        return;
+    }
+    // drops whatever an earlier, larger file left behind
+    error = MPI_File_set_size(file, header_size + (MPI_Offset)width * height);
+
+    if (error == MPI_SUCCESS && rank == 0) {
+        error = MPI_File_write_at(file, 0, header.data(), header.size(), MPI_CHAR,
+            MPI_STATUS_IGNORE);
+    }
+
+    // one vector type skips the row padding, so rows are not repacked first
+    MPI_Datatype row_type;
+    MPI_Type_vector(rows.height, width, rows.stride, MPI_UINT8_T, &row_type);
+    MPI_Type_commit(&row_type);
+    MPI_Offset offset = header_size + (MPI_Offset)start_y * width;
+    int write_error = MPI_File_write_at_all(file, offset, rows.data,
+        rows.height > 0 ? 1 : 0, row_type, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row_type);
+    MPI_File_close(&file);
+
+    // only rank 0 writes the header, so only it sees that write fail
+    int failed = error != MPI_SUCCESS || write_error != MPI_SUCCESS;
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, comm);
+    if (failed) {
+        reportFailure();
+    }
+}
+
+void writeTraceMPI(const std::string& path, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (!trace_enabled) {
+        // only warns, once
+        if (rank == 0) {
+            writeTrace(path);
+        }
+        return;
+    }
+
+    std::string events = traceEventsJson();
+    if (rank != 0) {
+        events = ",\n" + events;
+    }
+    int length = events.size();
+    std::vector<int> lengths(size);
+    std::vector<int> displs(size);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+
+    std::string merged;
+    if (rank == 0) {
+        int total = 0;
+        for (int i = 0; i < size; ++i) {
+            displs[i] = total;
+            total += lengths[i];
+        }
+        merged.resize(total);
+    }
+    MPI_Gatherv(events.data(), length, MPI_CHAR, rank == 0 ? &merged[0] : nullptr,
+        lengths.data(), displs.data(), MPI_CHAR, 0, comm);
+    if (rank == 0) {
+        writeTraceEvents(path, merged);
+    }
+}
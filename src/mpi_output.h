@@ -0,0 +1,39 @@
+#ifndef MPI_OUTPUT_H
+#define MPI_OUTPUT_H
+#include <string>
+#include <mpi.h>
+#include "image_buffer.h"
+
+// where the MPI executables put their results
+enum class MpiOutput {
+    // rows are gathered to rank 0, which encodes the image like the other backends
+    Images,
+    // every rank writes its own rows straight into one PGM file per image
+    SharedFile,
+};
+
+// reads --output=images|mpi-io, images if not given or unknown
+MpiOutput parseMpiOutput(int argc, char** argv);
+
+// <output_dir>/<name>_output.pgm for an input file called file_name
+std::string pgmOutputPath(const std::string& output_dir, const std::string& file_name);
+
+// Collective over comm: rank 0 creates output_dir if it is missing, which
+// MPI-IO does not do, before any rank goes on
+void createOutputDirectory(const std::string& output_dir, MPI_Comm comm);
+
+// Collective over comm. Rank r passes rows [start_y, start_y + rows.height)
+// of a width x height uint8 image, in rank order, and they all land in a
+// binary PGM at path through one collective MPI-IO write. Rows keep their
+// padded stride in memory, the file holds them packed. The directory must
+// already exist. If any rank fails to write, rank 0 reports it and every rank
+// returns as usual, so they all move on to the next image together.
+void writeRowsPGM(const std::string& path, ImageView<const uint8_t> rows,
+    int width, int height, int start_y, MPI_Comm comm);
+
+// Collective over comm: every rank's trace events, see trace.h, are gathered
+// to rank 0 and written to one Chrome trace at path with a process per rank.
+// Call traceStart right after a barrier, so the ranks share a time origin
+void writeTraceMPI(const std::string& path, MPI_Comm comm);
+
+#endif
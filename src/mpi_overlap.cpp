@@ -0,0 +1,71 @@
+#include <iostream>
+#include "mpi_overlap.h"
+
+namespace {
+
+void saveAndDelete(GrayImage* image, const std::string& output_dir, bool verbose) {
+    image->saveImage(output_dir);
+    if (verbose) {
+        std::cout << "Saved output of image ["
+            << image->file_name << "] successfully" << std::endl;
+    }
+    delete image;
+}
+
+}
+
+bool parseMpiOverlapArg(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--overlap") {
+            return true;
+        }
+    }
+    return false;
+}
+
+void reportWaitTimes(const MpiWaitTimes& times, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    long long local[4] = {times.scatter, times.halo, times.gather, times.save};
+    long long total[4];
+    long long longest[4];
+    MPI_Reduce(local, total, 4, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    MPI_Reduce(local, longest, 4, MPI_LONG_LONG, MPI_MAX, 0, comm);
+
+    if (rank == 0) {
+        const char* phases[4] = {"scatter", "halo", "gather", "save"};
+        std::cout << "Wait per rank (mean / max):";
+        for (int i = 0; i < 4; ++i) {
+            std::cout << (i == 0 ? " " : ", ") << phases[i] << " "
+                << total[i] / size << " / " << longest[i] << " ns";
+        }
+        std::cout << std::endl;
+    }
+}
+
+ImageSaver::ImageSaver(std::string output_dir, bool background, bool verbose):
+    output_dir(std::move(output_dir)), background(background), verbose(verbose) {}
+
+ImageSaver::~ImageSaver() {
+    if (pending.valid()) {
+        pending.wait();
+    }
+}
+
+void ImageSaver::save(GrayImage* image, MpiWaitTimes* times) {
+    if (!background) {
+        timeWait(&times->save, [&]() { saveAndDelete(image, output_dir, verbose); });
+        return;
+    }
+
+    finish(times);
+    pending = std::async(std::launch::async, saveAndDelete, image, output_dir, verbose);
+}
+
+void ImageSaver::finish(MpiWaitTimes* times) {
+    if (!pending.valid()) { return; }
+    // get() rethrows a failed write here
+    timeWait(&times->save, [&]() { pending.get(); });
+}
@@ -0,0 +1,60 @@
+#ifndef MPI_OVERLAP_H
+#define MPI_OVERLAP_H
+#include <chrono>
+#include <future>
+#include <string>
+#include <mpi.h>
+#include "gray_image.h"
+
+// Time a rank spent blocked instead of computing, per phase, in nanoseconds
+struct MpiWaitTimes {
+    // waiting for input rows from rank 0, or sending them
+    long long scatter = 0;
+    // waiting for halo rows from the neighbouring ranks
+    long long halo = 0;
+    // in the final gather to rank 0
+    long long gather = 0;
+    // waiting for output images to be written
+    long long save = 0;
+};
+
+// reads --overlap
+bool parseMpiOverlapArg(int argc, char** argv);
+
+// runs wait() and adds the time it took to *total
+template <typename Wait>
+void timeWait(long long* total, Wait wait) {
+    auto start = std::chrono::steady_clock::now();
+    wait();
+    auto end = std::chrono::steady_clock::now();
+    *total += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+// Collective over comm: rank 0 prints the mean and the largest wait of every
+// phase across the ranks
+void reportWaitTimes(const MpiWaitTimes& times, MPI_Comm comm);
+
+// Writes processed images and deletes them. In the background, a write runs
+// on its own thread while the caller goes on to the next image, so the MPI
+// ranks waiting on the caller do not wait for the disk too. Only one write is
+// in flight at a time, which keeps at most one extra image in memory. The
+// writer thread makes no MPI calls.
+struct ImageSaver {
+    std::string output_dir;
+    bool background;
+    bool verbose;
+    std::future<void> pending;
+
+    ImageSaver(std::string output_dir, bool background, bool verbose);
+    ~ImageSaver();
+
+    ImageSaver(const ImageSaver&) = delete;
+    ImageSaver& operator=(const ImageSaver&) = delete;
+
+    // takes ownership of image, the time spent blocked goes to times->save
+    void save(GrayImage* image, MpiWaitTimes* times);
+    // waits for the last write
+    void finish(MpiWaitTimes* times);
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include <cstring>
+#include <iostream>
+#include "mpi_scatter.h"
+#include "trace.h"
+
+void broadcastImageSize(const GrayImage* image, MPI_Comm comm, int* width, int* height) {
+    int size[2] = {0, 0};
+    if (image) {
+        size[0] = image->width;
+        size[1] = image->height;
+    }
+    TRACE_SCOPE("MPI_Bcast");
+    MPI_Bcast(size, 2, MPI_INT, 0, comm);
+    *width = size[0];
+    *height = size[1];
+}
+
+void skipSmallImage(const GrayImage* image, int width, int height, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == 0) {
+        std::cout << "Image [" << image->file_name << "] of " << width << "x" << height
+            << " is too small for the kernels, skip" << std::endl;
+    }
+}
+
+ImageView<const uint8_t> scatterRows(ImageView<const uint8_t> image, int width, int height,
+    int rows_per_process, int halo, ImageBuffer<uint8_t>* local, MPI_Comm comm
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // input rows of every rank, neighbouring blocks overlap by `halo` rows
+    int output_height = height - halo;
+    int start_y[size];
+    int rows[size];
+    for (int i = 0; i < size; ++i) {
+        start_y[i] = i * rows_per_process;
+        int end_y = (i == size - 1) ? output_height : start_y[i] + rows_per_process;
+        rows[i] = (end_y > start_y[i]) ? end_y - start_y[i] + halo : 0;
+    }
+
+    if (size == 1) {
+        return image;
+    }
+
+    // every buffer gets the same row stride, so padded rows travel as they are
+    int stride = alignedStride(width, sizeof(uint8_t));
+    int send_counts[size];
+    int displs[size];
+    ImageBuffer<uint8_t> packed;
+    if (rank == 0) {
+        // Scatterv must not read a location twice, so the rows the blocks
+        // share are copied into a send buffer once per block. Rank 0's own
+        // rows stay where they are
+        send_counts[0] = 0;
+        displs[0] = 0;
+        int packed_rows = 0;
+        for (int i = 1; i < size; ++i) {
+            packed_rows += rows[i];
+        }
+        packed = ImageBuffer<uint8_t>(width, packed_rows);
+
+        int packed_y = 0;
+        for (int i = 1; i < size; ++i) {
+            send_counts[i] = rows[i] * stride;
+            displs[i] = packed_y * stride;
+            for (int y = 0; y < rows[i]; ++y) {
+                memcpy(packed[packed_y + y], image[start_y[i] + y], width);
+            }
+            packed_y += rows[i];
+        }
+
+        TRACE_SCOPE("MPI_Scatterv");
+        MPI_Scatterv(packed.data, send_counts, displs, MPI_UINT8_T,
+            MPI_IN_PLACE, 0, MPI_UINT8_T, 0, comm);
+        return image.roi(0, 0, width, rows[0]);
+    }
+
+    *local = ImageBuffer<uint8_t>(width, rows[rank]);
+    TRACE_SCOPE("MPI_Scatterv");
+    MPI_Scatterv(nullptr, nullptr, nullptr, MPI_UINT8_T,
+        local->data, rows[rank] * stride, MPI_UINT8_T, 0, comm);
+    return local->view();
+}
@@ -0,0 +1,27 @@
+#ifndef MPI_SCATTER_H
+#define MPI_SCATTER_H
+#include <mpi.h>
+#include "gray_image.h"
+
+// Only rank 0 decodes images. The other ranks learn the size from it and get
+// just the rows they compute on, so decoding time and memory do not grow with
+// the number of ranks.
+
+// Sends the size of the image rank 0 holds to every rank of comm. Zero when
+// rank 0 passes nullptr because the image failed to decode
+void broadcastImageSize(const GrayImage* image, MPI_Comm comm, int* width, int* height);
+
+// Called by every rank when the broadcast size leaves no output rows or
+// columns, before any other MPI call for the image. Rank 0 says it skips it
+void skipSmallImage(const GrayImage* image, int width, int height, MPI_Comm comm);
+
+// Scatters the uint8 pixels of rank 0's `image` by blocks of output rows:
+// every rank gets output rows [rank * rows_per_process, ...), the last rank
+// takes the remainder, and each block comes with the `halo` rows below it
+// that the kernels read past the block. Rank 0 keeps reading its own rows from
+// `image`, the other ranks receive theirs into `local`. Returns the rows of
+// the calling rank, starting with the first input row of its block
+ImageView<const uint8_t> scatterRows(ImageView<const uint8_t> image, int width, int height,
+    int rows_per_process, int halo, ImageBuffer<uint8_t>* local, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,68 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "mpi_threads.h"
+
+namespace {
+
+#ifdef _OPENMP
+const char* procBindName(omp_proc_bind_t bind) {
+    switch (bind) {
+        case omp_proc_bind_false: return "none";
+        case omp_proc_bind_true: return "true";
+        case omp_proc_bind_master: return "master";
+        case omp_proc_bind_close: return "close";
+        case omp_proc_bind_spread: return "spread";
+    }
+    return "unknown";
+}
+#endif
+
+}
+
+void initMpiThreads(int* argc, char*** argv) {
+    int provided;
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+    if (provided < MPI_THREAD_FUNNELED) {
+        std::cerr << "MPI library does not support MPI_THREAD_FUNNELED" << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+int parseRankThreadsArg(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg.rfind("--threads=", 0) == 0) {
+            return std::max(0, std::atoi(arg.c_str() + 10));
+        }
+    }
+    return 0;
+}
+
+void setupRankThreads(int threads, MPI_Comm comm, bool verbose) {
+#ifdef _OPENMP
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+#endif
+
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (rank == 0) {
+        std::cout << "Using " << size << " ranks with " << rankThreads()
+            << " threads each" << std::endl;
+    }
+    if (!verbose) { return; }
+
+    char host[MPI_MAX_PROCESSOR_NAME];
+    int host_length;
+    MPI_Get_processor_name(host, &host_length);
+    std::string binding = "single thread";
+#ifdef _OPENMP
+    binding = std::string("thread binding ") + procBindName(omp_get_proc_bind()) +
+        " over " + std::to_string(omp_get_num_places()) + " places";
+#endif
+    std::cout << "Rank " << rank << " on [" << std::string(host, host_length) << "], "
+        << binding << std::endl;
+}
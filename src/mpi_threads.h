@@ -0,0 +1,56 @@
+#ifndef MPI_THREADS_H
+#define MPI_THREADS_H
+#include <algorithm>
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// The hybrid executables are the MPI sources built with OpenMP: ranks split
+// the work as in the MPI executables, and each rank computes its rows with a
+// team of threads. Built without OpenMP, everything below runs on the
+// calling thread. Either way only the main thread makes MPI calls.
+
+#ifdef _OPENMP
+const bool hybrid_build = true;
+#else
+const bool hybrid_build = false;
+#endif
+
+// MPI_Init_thread with MPI_THREAD_FUNNELED, aborts if the library offers less
+void initMpiThreads(int* argc, char*** argv);
+
+// reads --threads=N, the threads of every rank. 0 if not given, which keeps
+// the OpenMP default (OMP_NUM_THREADS, or one thread per core the rank may use)
+int parseRankThreadsArg(int argc, char** argv);
+
+// applies --threads, then rank 0 prints the ranks and threads per rank. With
+// verbose every rank also prints its host and thread binding
+void setupRankThreads(int threads, MPI_Comm comm, bool verbose);
+
+inline int rankThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Splits rows [start_y, end_y) into one block per thread of the rank and runs
+// stage(block_start, block_end) on each. The stages are row-range functions,
+// so blocks need no synchronization beyond the end of the loop
+template <typename Stage>
+void parallelRows(int start_y, int end_y, Stage stage) {
+    int height = end_y - start_y;
+    if (height <= 0) { return; }
+    int blocks = std::max(1, std::min(rankThreads(), height));
+
+    #pragma omp parallel for if (blocks > 1)
+    for (int i = 0; i < blocks; ++i) {
+        int block_start = start_y + (int)((long)height * i / blocks);
+        int block_end = start_y + (int)((long)height * (i + 1) / blocks);
+        stage(block_start, block_end);
+    }
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include <stdexcept>
+#include "pgm_file.h"
+#include "trace.h"
+
+PgmFile::PgmFile(const std::string& path):
+    path(path), width(0), height(0),
+    file(path, std::ios::in | std::ios::binary)
+{
+    std::string magic;
+    int max_value = 0;
+    file >> magic >> width >> height >> max_value;
+    if (!file || magic != "P5" || max_value != 255 || width <= 0 || height <= 0) {
+        throw std::runtime_error("Failed to read image: " + path);
+    }
+    // exactly one whitespace character separates the header from the pixels
+    file.get();
+    data_offset = file.tellg();
+}
+
+PgmFile::PgmFile(const std::string& path, int width, int height):
+    path(path), width(width), height(height),
+    file(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc)
+{
+    file << "P5\n" << width << " " << height << "\n255\n";
+    data_offset = file.tellp();
+    if (!file) {
+        throw std::runtime_error("Failed to save image: " + path);
+    }
+}
+
+void PgmFile::readRows(int start_y, ImageView<uint8_t> rows) {
+    TRACE_SCOPE("readRows");
+    file.seekg(data_offset + (std::streamoff)start_y * width);
+    for (int y = 0; y < rows.height; ++y) {
+        file.read(reinterpret_cast<char*>(rows[y]), width);
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to read image: " + path);
+    }
+}
+
+void PgmFile::writeRows(int start_y, ImageView<const uint8_t> rows) {
+    TRACE_SCOPE("writeRows");
+    file.seekp(data_offset + (std::streamoff)start_y * width);
+    for (int y = 0; y < rows.height; ++y) {
+        file.write(reinterpret_cast<const char*>(rows[y]), width);
+    }
+    // flushed, so rows written here can be read back right away
+    file.flush();
+    if (!file) {
+        throw std::runtime_error("Failed to save image: " + path);
+    }
+}
+
+ImageBuffer<uint8_t> readPGM(const std::string& path) {
+    PgmFile file(path);
+    ImageBuffer<uint8_t> image(file.width, file.height);
+    file.readRows(0, image.view());
+    return image;
+}
+
+void writePGM(const std::string& path, ImageView<const uint8_t> image) {
+    PgmFile file(path, image.width, image.height);
+    file.writeRows(0, image);
+}
@@ -0,0 +1,34 @@
+#ifndef PGM_FILE_H
+#define PGM_FILE_H
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "image_buffer.h"
+
+// Binary 8 bit PGM (P5) image on disk, read and written a band of rows at a
+// time, so an image never has to fit in memory as a whole. Every method throws
+// std::runtime_error if the file cannot be read or written
+struct PgmFile {
+    std::string path;
+    int width, height;
+
+    // opens an existing image, which must be an 8 bit P5 image
+    explicit PgmFile(const std::string& path);
+    // creates an image of the given size for writing, replacing any file at path
+    PgmFile(const std::string& path, int width, int height);
+
+    // rows [start_y, start_y + rows.height) into `rows`
+    void readRows(int start_y, ImageView<uint8_t> rows);
+    void writeRows(int start_y, ImageView<const uint8_t> rows);
+
+private:
+    std::fstream file;
+    // where row 0 starts, right after the header
+    std::streamoff data_offset;
+};
+
+// Whole images, the format the MPI executables write with MPI-IO
+ImageBuffer<uint8_t> readPGM(const std::string& path);
+void writePGM(const std::string& path, ImageView<const uint8_t> image);
+
+#endif
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include "pipeline.h"
+#include "sobel/sobel_batch.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int parsePositive(const std::string& arg, size_t prefix_length, int fallback) {
+    int value = std::atoi(arg.c_str() + prefix_length);
+    return value > 0 ? value : fallback;
+}
+
+}
+
+PipelineConfig parsePipelineArgs(int argc, char** argv) {
+    PipelineConfig config;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg.rfind("--decode-threads=", 0) == 0) {
+            config.decode_threads = parsePositive(arg, 17, config.decode_threads);
+        } else if (arg.rfind("--encode-threads=", 0) == 0) {
+            config.encode_threads = parsePositive(arg, 17, config.encode_threads);
+        } else if (arg.rfind("--decode-depth=", 0) == 0) {
+            config.decode_depth = parsePositive(arg, 15, config.decode_depth);
+        } else if (arg.rfind("--encode-depth=", 0) == 0) {
+            config.encode_depth = parsePositive(arg, 15, config.encode_depth);
+        }
+    }
+    return config;
+}
+
+ImagePipeline::ImagePipeline(std::vector<ImageSource> sources, PixelFormat format,
+    std::string output_dir, const PipelineConfig& config, bool verbose
+):
+    sources(std::move(sources)), format(format), output_dir(output_dir), verbose(verbose),
+    decoded(config.decode_depth), computed(config.encode_depth),
+    next_source(0), running_decoders(config.decode_threads), compute_finished(false)
+{
+    // created once here, so the encode threads never race on it
+    if (!fs::exists(output_dir)) {
+        fs::create_directories(output_dir);
+    }
+
+    for (int i = 0; i < config.decode_threads; ++i) {
+        decoders.emplace_back(&ImagePipeline::decodeLoop, this);
+    }
+    for (int i = 0; i < config.encode_threads; ++i) {
+        encoders.emplace_back(&ImagePipeline::encodeLoop, this);
+    }
+}
+
+ImagePipeline::~ImagePipeline() {
+    finish();
+}
+
+void ImagePipeline::decodeLoop() {
+    while (true) {
+        size_t index = next_source.fetch_add(1);
+        if (index >= sources.size()) { break; }
+
+        const ImageSource& source = sources[index];
+        GrayImage* image = nullptr;
+        try {
+            image = new GrayImage(source, format);
+        } catch (std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            std::cerr << "Failed to load image [" << source.file_name << "], skip" << std::endl;
+            continue;
+        }
+        if (verbose) {
+            std::cout << "Loaded image [" << source.file_name << "] successfully, dimension: "
+                << image->width << "x" << image->height << std::endl;
+        }
+
+        Backoff backoff;
+        while (!decoded.tryPush(image)) {
+            backoff.wait();
+        }
+    }
+    running_decoders.fetch_sub(1, std::memory_order_release);
+}
+
+GrayImage* ImagePipeline::next() {
+    GrayImage* image = nullptr;
+    Backoff backoff;
+    while (!decoded.tryPop(&image)) {
+        if (running_decoders.load(std::memory_order_acquire) == 0) {
+            // the decoders may have pushed their last image just before exiting
+            return decoded.tryPop(&image) ? image : nullptr;
+        }
+        backoff.wait();
+    }
+    return image;
+}
+
+void ImagePipeline::done(GrayImage* image) {
+    Backoff backoff;
+    while (!computed.tryPush(image)) {
+        backoff.wait();
+    }
+}
+
+void ImagePipeline::encodeLoop() {
+    while (true) {
+        GrayImage* image = nullptr;
+        Backoff backoff;
+        while (!computed.tryPop(&image)) {
+            if (compute_finished.load(std::memory_order_acquire)) {
+                if (computed.tryPop(&image)) { break; }
+                return;
+            }
+            backoff.wait();
+        }
+
+        image->saveImage(output_dir);
+        if (verbose) {
+            std::cout << "Saved output of image ["
+                << image->file_name << "] successfully" << std::endl;
+        }
+        delete image;
+    }
+}
+
+void ImagePipeline::finish() {
+    compute_finished.store(true, std::memory_order_release);
+    for (auto& thread : encoders) {
+        if (thread.joinable()) { thread.join(); }
+    }
+    for (auto& thread : decoders) {
+        if (thread.joinable()) { thread.join(); }
+    }
+}
+
+void detectEdges(GrayImage* image, EdgeAlgorithm algorithm, EdgeBackend backend,
+    const EdgeParams& params
+) {
+    ImageBuffer<uint8_t> edges(edgeOutputWidth(algorithm, image->width, params),
+        edgeOutputHeight(algorithm, image->height, params));
+    if (image->format == PixelFormat::UInt8) {
+        detectEdges(image->pixelView(), edges.view(), algorithm, backend, params);
+    } else {
+        detectEdges(image->view(), edges.view(), algorithm, backend, params);
+    }
+    image->assign(std::move(edges));
+}
+
+void sobelBatch(const std::vector<GrayImage*>& images, const SobelConfig& config) {
+    std::vector<GrayImage*> sorted = images;
+    std::sort(sorted.begin(), sorted.end(), [](const GrayImage* a, const GrayImage* b) {
+        return std::make_pair(a->width, a->height) < std::make_pair(b->width, b->height);
+    });
+
+    std::vector<ImageView<const float>> inputs;
+    std::vector<ImageBuffer<uint8_t>> edges;
+    std::vector<ImageView<uint8_t>> outputs;
+    for (size_t start = 0; start < sorted.size();) {
+        size_t end = start;
+        inputs.clear();
+        edges.clear();
+        outputs.clear();
+        for (; end < sorted.size() && sorted[end]->width == sorted[start]->width &&
+                sorted[end]->height == sorted[start]->height; ++end) {
+            inputs.push_back(sorted[end]->view());
+            edges.emplace_back(getOutputWidth(sorted[end]->width),
+                getOutputHeight(sorted[end]->height));
+            outputs.push_back(edges.back().view());
+        }
+
+        sobelBatchCPU(inputs, outputs, config.simd, BatchSchedule::Nested, false);
+        for (size_t i = start; i < end; ++i) {
+            sorted[i]->assign(std::move(edges[i - start]));
+        }
+        start = end;
+    }
+}
+
+void processBatches(ImagePipeline* pipeline, const SobelConfig& config, bool verbose) {
+    size_t lanes = sobelBatchLanes(config.simd);
+    std::vector<GrayImage*> batch;
+    while (true) {
+        batch.clear();
+        while (batch.size() < lanes) {
+            GrayImage* image = pipeline->next();
+            if (!image) { break; }
+            batch.push_back(image);
+        }
+        if (batch.empty()) { return; }
+
+        if (verbose) {
+            std::cout << "Processing batch of " << batch.size() << " images..." << std::endl;
+        }
+        sobelBatch(batch, config);
+        for (GrayImage* image : batch) {
+            pipeline->done(image);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded_queue.h"
+#include "edgedetect.h"
+#include "gray_image.h"
+
+struct PipelineConfig {
+    int decode_threads = 2;
+    int encode_threads = 1;
+    // decoded images waiting for a compute worker
+    int decode_depth = 8;
+    // finished images waiting to be written
+    int encode_depth = 8;
+};
+
+// reads --decode-threads=N, --encode-threads=N, --decode-depth=N and
+// --encode-depth=N, other arguments are left to the executable
+PipelineConfig parsePipelineArgs(int argc, char** argv);
+
+// Decode threads -> compute workers -> encode threads, joined by two bounded
+// lock-free queues. Decoding and writing run while the workers compute, and at
+// most decode_depth + encode_depth images wait between the stages, so memory
+// no longer grows with the size of the dataset.
+//
+// Compute workers are whatever threads the executable runs: each one calls
+// next() until it returns nullptr and passes every image to done(), which
+// saves and deletes it on an encode thread.
+struct ImagePipeline {
+    std::vector<ImageSource> sources;
+    PixelFormat format;
+    std::string output_dir;
+    bool verbose;
+
+    BoundedQueue<GrayImage*> decoded;
+    BoundedQueue<GrayImage*> computed;
+    std::atomic<size_t> next_source;
+    std::atomic<int> running_decoders;
+    std::atomic<bool> compute_finished;
+    std::vector<std::thread> decoders;
+    std::vector<std::thread> encoders;
+
+    ImagePipeline(std::vector<ImageSource> sources, PixelFormat format,
+        std::string output_dir, const PipelineConfig& config, bool verbose);
+    ~ImagePipeline();
+
+    ImagePipeline(const ImagePipeline&) = delete;
+    ImagePipeline& operator=(const ImagePipeline&) = delete;
+
+    // blocks until an image is decoded, nullptr once every image was handed out
+    GrayImage* next();
+
+    // hands a processed image to the encode threads, blocks while they are behind
+    void done(GrayImage* image);
+
+    // waits until every image passed to done() is written
+    void finish();
+
+    void decodeLoop();
+    void encodeLoop();
+};
+
+// Runs detectEdges on the pixels the image was loaded with, uint8 or float,
+// and replaces them with the edges
+void detectEdges(GrayImage* image, EdgeAlgorithm algorithm, EdgeBackend backend,
+    const EdgeParams& params);
+
+// The same for Sobel on float images, with images of the same size run
+// together through sobelBatchCPU on the calling thread
+void sobelBatch(const std::vector<GrayImage*>& images, const SobelConfig& config);
+
+// Takes images from the pipeline sobelBatchLanes at a time and runs them
+// through sobelBatch until the pipeline is empty. Each thread of a team can
+// call it, every one then fills its own batches
+void processBatches(ImagePipeline* pipeline, const SobelConfig& config, bool verbose);
+
+#endif
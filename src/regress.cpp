@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include "benchmark.h"
+#include "edgedetect.h"
+#include "image_cache.h"
+#include "image_compare.h"
+#include "pgm_file.h"
+#include "synthetic_image.h"
+#include "canny/canny_int.h"
+#include "sobel/sobel_int.h"
+
+namespace fs = std::filesystem;
+
+// Checks every backend against the sequential one, and the sequential one
+// against golden images from an earlier run. Inputs are the dataset and a
+// fixed set of generated images. The in-process backends see both. The MPI
+// executables only read the dataset, so they run under mpirun with
+// --output=mpi-io, whose PGM files hold their edges exactly. Throughput
+// is checked as well, against a stored baseline. Exits with 1 if any check
+// fails, so it can guard a change to the kernels. With --integer, every
+// backend must also match the integer kernels' plain-loop reference exactly.
+
+struct RegressConfig {
+    std::vector<std::string> algorithms = {"sobel", "canny"};
+    // seq is the reference and always runs, listing it checks its speed
+    std::vector<std::string> backends = {"seq", "omp", "mpi"};
+    int np = 4;
+    std::string mpirun_args;
+    std::string golden_dir;
+    bool update_golden = false;
+    std::string baseline_path;
+    bool update_baseline = false;
+    // fraction of the baseline throughput a backend may lose
+    double tolerance = 0.1;
+    int reps = 3;
+    // outputs that differ from the reference pass only above these, so by
+    // default every backend must match pixel for pixel
+    double min_psnr = std::numeric_limits<double>::infinity();
+    double min_f_score = 1.0;
+    // arguments regress does not know, passed on to the MPI executables
+    std::vector<std::string> forwarded;
+};
+
+struct RegressInput {
+    // file name, or pattern_WxH for generated images
+    std::string name;
+    // the MPI executables see dataset images only
+    bool dataset;
+    ImageBuffer<uint8_t> pixels;
+    ImageBuffer<float> image;
+};
+
+struct CheckCounts {
+    int checks = 0;
+    int failures = 0;
+
+    void record(bool passed, const std::string& what) {
+        ++checks;
+        failures += !passed;
+        std::cout << "  [" << (passed ? "PASS" : "FAIL") << "] " << what << std::endl;
+    }
+};
+
+RegressConfig parseRegressArgs(int argc, char** argv) {
+    RegressConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--algorithms=", 0) == 0) {
+            config.algorithms = splitList(arg.substr(13));
+        } else if (arg.rfind("--backends=", 0) == 0) {
+            config.backends = splitList(arg.substr(11));
+        } else if (arg.rfind("--np=", 0) == 0) {
+            config.np = std::max(1, atoi(arg.c_str() + 5));
+        } else if (arg.rfind("--mpirun-args=", 0) == 0) {
+            config.mpirun_args = arg.substr(14);
+        } else if (arg.rfind("--golden=", 0) == 0) {
+            config.golden_dir = arg.substr(9);
+        } else if (arg == "--update-golden") {
+            config.update_golden = true;
+        } else if (arg.rfind("--baseline=", 0) == 0) {
+            config.baseline_path = arg.substr(11);
+        } else if (arg == "--update-baseline") {
+            config.update_baseline = true;
+        } else if (arg.rfind("--tolerance=", 0) == 0) {
+            config.tolerance = std::max(0.0, atof(arg.c_str() + 12));
+        } else if (arg.rfind("--reps=", 0) == 0) {
+            config.reps = std::max(1, atoi(arg.c_str() + 7));
+        } else if (arg.rfind("--min-psnr=", 0) == 0) {
+            config.min_psnr = atof(arg.c_str() + 11);
+        } else if (arg.rfind("--min-fscore=", 0) == 0) {
+            config.min_f_score = atof(arg.c_str() + 13);
+        } else if (arg != "-v" && arg != "--verbose") {
+            config.forwarded.push_back(arg);
+        }
+    }
+    return config;
+}
+
+long long elapsedNs(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+    return chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+}
+
+std::string stripExtension(const std::string& file_name) {
+    return file_name.substr(0, file_name.find_last_of("."));
+}
+
+// the dataset, then every pattern at an odd size that splits unevenly among
+// ranks and threads and at a larger one
+std::vector<RegressInput> loadInputs(const std::vector<ImageSource>& sources) {
+    std::vector<RegressInput> inputs;
+    for (GrayImage* image : loadImages(sources, false, PixelFormat::UInt8)) {
+        ImageView<const uint8_t> pixels = image->pixelView();
+        ImageBuffer<uint8_t> copy(pixels.width, pixels.height);
+        for (int y = 0; y < pixels.height; ++y) {
+            std::copy(pixels[y], pixels[y] + pixels.width, copy[y]);
+        }
+        inputs.push_back({image->file_name, true, std::move(copy), widenPixels(pixels, false)});
+        delete image;
+    }
+
+    const std::pair<int, int> sizes[] = {{97, 61}, {640, 480}};
+    for (SyntheticPattern pattern : allSyntheticPatterns()) {
+        for (const auto& size : sizes) {
+            std::string name = std::string(syntheticPatternName(pattern)) + "_" +
+                std::to_string(size.first) + "x" + std::to_string(size.second);
+            ImageBuffer<uint8_t> pixels = syntheticImage(pattern, size.first, size.second);
+            ImageBuffer<float> image = widenPixels(pixels.view(), false);
+            inputs.push_back({name, false, std::move(pixels), std::move(image)});
+        }
+    }
+    return inputs;
+}
+
+// the Canny params that differ from the defaults, e.g. "_gaussian7_sigma1.4"
+std::string cannyParamsSuffix(const CannyConfig& canny) {
+    CannyConfig defaults;
+    std::ostringstream suffix;
+    if (canny.gaussian_size != defaults.gaussian_size ||
+            canny.gaussian_sd != defaults.gaussian_sd) {
+        suffix << "_gaussian" << canny.gaussian_size << "_sigma" << canny.gaussian_sd;
+    }
+    if (canny.low_threshold != defaults.low_threshold ||
+            canny.high_threshold != defaults.high_threshold) {
+        suffix << "_thresholds" << canny.low_threshold << "-" << canny.high_threshold;
+    }
+    if (canny.gradient == GradientOperator::Scharr) {
+        suffix << "_scharr";
+    } else if (canny.gradient == GradientOperator::Prewitt) {
+        suffix << "_prewitt";
+    }
+    return suffix.str();
+}
+
+// which golden images a configuration is checked against: the options that
+// change the edges get their own set
+std::string goldenSet(EdgeAlgorithm algorithm, const EdgeParams& params) {
+    if (algorithm == EdgeAlgorithm::Sobel) {
+        return params.sobel.integer ? "sobel_integer" : "sobel";
+    }
+    std::string suffix = cannyParamsSuffix(params.canny);
+    if (params.canny.integer) { return "canny_integer" + suffix; }
+    return (params.canny.gaussian == GaussianMode::Full2D ?
+        "canny_full_gaussian" : "canny") + suffix;
+}
+
+// exact comparisons pass on identical images only, whatever the tolerances
+bool acceptable(const ImageComparison& comparison, EdgeAlgorithm algorithm,
+    const RegressConfig& config, bool exact
+) {
+    if (!comparison.same_size) { return false; }
+    if (comparison.differing_pixels == 0) { return true; }
+    if (exact) { return false; }
+    return algorithm == EdgeAlgorithm::Sobel ?
+        comparison.psnr >= config.min_psnr : comparison.f_score >= config.min_f_score;
+}
+
+void checkOutput(const std::string& what, ImageView<const uint8_t> reference,
+    ImageView<const uint8_t> output, EdgeAlgorithm algorithm, const RegressConfig& config,
+    bool exact, CheckCounts* counts
+) {
+    ImageComparison comparison = compareImages(reference, output);
+    std::ostringstream detail;
+    if (!comparison.same_size) {
+        detail << "size " << output.width << "x" << output.height << " instead of "
+            << reference.width << "x" << reference.height;
+    } else if (comparison.differing_pixels == 0) {
+        detail << "identical";
+    } else {
+        detail << comparison.differing_pixels << " pixels differ (max "
+            << comparison.max_difference << "), " << std::fixed << std::setprecision(4);
+        if (algorithm == EdgeAlgorithm::Sobel) {
+            detail << "PSNR " << comparison.psnr << " dB";
+        } else {
+            detail << "F-score " << comparison.f_score;
+        }
+    }
+    counts->record(acceptable(comparison, algorithm, config, exact), what + ": " + detail.str());
+}
+
+// Edges of every input on an in-process backend. Afterwards the dataset
+// inputs are run `reps` more times, and the median of those passes is the
+// backend's time
+std::vector<ImageBuffer<uint8_t>> runInProcess(const std::vector<RegressInput>& inputs,
+    EdgeAlgorithm algorithm, EdgeBackend backend, const EdgeParams& params, int reps,
+    long long* median_ns
+) {
+    bool integer = algorithm == EdgeAlgorithm::Sobel ? params.sobel.integer : params.canny.integer;
+    auto run = [&](const RegressInput& input, ImageView<uint8_t> edges) {
+        if (integer) {
+            detectEdges(input.pixels.view(), edges, algorithm, backend, params);
+        } else {
+            detectEdges(input.image.view(), edges, algorithm, backend, params);
+        }
+    };
+
+    std::vector<ImageBuffer<uint8_t>> outputs;
+    for (const auto& input : inputs) {
+        outputs.emplace_back(edgeOutputWidth(algorithm, input.pixels.width, params),
+            edgeOutputHeight(algorithm, input.pixels.height, params));
+        run(input, outputs.back().view());
+    }
+
+    std::vector<long long> samples;
+    for (int rep = 0; rep < reps; ++rep) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (inputs[i].dataset) {
+                run(inputs[i], outputs[i].view());
+            }
+        }
+        samples.push_back(elapsedNs(start, chrono::steady_clock::now()));
+    }
+    *median_ns = summarize(samples).median;
+    return outputs;
+}
+
+// Edges of every input from sobelIntegerReference or cannyIntegerReference
+std::vector<ImageBuffer<uint8_t>> runIntegerReference(const std::vector<RegressInput>& inputs,
+    EdgeAlgorithm algorithm, const EdgeParams& params
+) {
+    std::vector<ImageBuffer<uint8_t>> outputs;
+    for (const auto& input : inputs) {
+        if (algorithm == EdgeAlgorithm::Sobel) {
+            outputs.emplace_back(getOutputWidth(input.pixels.width),
+                getOutputHeight(input.pixels.height));
+            sobelIntegerReference(input.pixels.view(), outputs.back().view());
+        } else {
+            outputs.emplace_back();
+            cannyIntegerReference(input.pixels.view(), &outputs.back(), params.canny);
+        }
+    }
+    return outputs;
+}
+
+// Runs an MPI executable `reps` times with --output=mpi-io. The median of
+// the Durations it prints, decoding and saving included, is its time. False
+// if a run failed
+bool runMpiExecutable(const std::string& algorithm_name, const std::string& backend_name,
+    const RegressConfig& config, long long* median_ns
+) {
+    std::vector<std::string> args = {"--output=mpi-io"};
+    args.insert(args.end(), config.forwarded.begin(), config.forwarded.end());
+    std::string command = mpirunCommand("./" + algorithm_name + "_" + backend_name,
+        config.np, config.mpirun_args, args);
+
+    std::vector<long long> samples;
+    for (int rep = 0; rep < config.reps; ++rep) {
+        MpiRunTimes times;
+        if (!runMpiCommand(command, &times) || times.duration < 0) {
+            std::cerr << "Execute [" << command << "] failed" << std::endl;
+            return false;
+        }
+        samples.push_back(times.duration);
+    }
+    *median_ns = summarize(samples).median;
+    return true;
+}
+
+// algorithm,backend -> pixels per second, from a file written by --update-baseline
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields = splitList(line);
+        if (fields.size() == 3) {
+            baseline[fields[0] + "," + fields[1]] = atof(fields[2].c_str());
+        }
+    }
+    return baseline;
+}
+
+void writeBaseline(const std::string& path, const std::map<std::string, double>& throughput) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to write baseline: " + path);
+    }
+    file << "algorithm,backend,pixels_per_s\n";
+    for (const auto& entry : throughput) {
+        file << entry.first << "," << (long long)entry.second << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    RegressConfig config = parseRegressArgs(argc, argv);
+    bool verbose = false;
+    EdgeParams params;
+    params.sobel = parseSobelArgs(argc, argv, &verbose);
+    params.canny = parseCannyArgs(argc, argv, &verbose);
+    std::string cache_path = parseImageCacheArg(argc, argv);
+
+    std::cout << "==========Regression Check==========" << std::endl;
+    std::cout << "Loading images..." << std::endl;
+    ImageCache cache;
+    std::vector<RegressInput> inputs = loadInputs(listDatasetImages(cache_path, &cache, false));
+    double dataset_pixels = 0.0;
+    for (const auto& input : inputs) {
+        if (input.dataset) {
+            dataset_pixels += (double)input.pixels.width * input.pixels.height;
+        }
+    }
+
+    CheckCounts counts;
+    std::map<std::string, double> baseline;
+    if (!config.baseline_path.empty() && !config.update_baseline) {
+        baseline = readBaseline(config.baseline_path);
+    }
+    std::map<std::string, double> throughput;
+
+    for (const auto& algorithm_name : config.algorithms) {
+        if (algorithm_name != "sobel" && algorithm_name != "canny") {
+            std::cerr << "Unknown algorithm [" << algorithm_name << "], skip" << std::endl;
+            continue;
+        }
+        EdgeAlgorithm algorithm = algorithm_name == "sobel" ?
+            EdgeAlgorithm::Sobel : EdgeAlgorithm::Canny;
+        std::cout << "----" << algorithm_name << "----" << std::endl;
+
+        long long reference_ns = 0;
+        std::vector<ImageBuffer<uint8_t>> reference = runInProcess(inputs, algorithm,
+            EdgeBackend::Sequential, params, config.reps, &reference_ns);
+        bool integer = algorithm == EdgeAlgorithm::Sobel ?
+            params.sobel.integer : params.canny.integer;
+        std::vector<ImageBuffer<uint8_t>> integer_reference;
+        if (integer) {
+            integer_reference = runIntegerReference(inputs, algorithm, params);
+        }
+        // against the sequential backend within the tolerances, and for the
+        // integer kernels against their reference exactly
+        auto checkBackend = [&](const std::string& what, size_t i,
+            ImageView<const uint8_t> output
+        ) {
+            checkOutput(what, reference[i].view(), output, algorithm, config, false, &counts);
+            if (integer) {
+                checkOutput(what + " against integer reference", integer_reference[i].view(),
+                    output, algorithm, config, true, &counts);
+            }
+        };
+        if (integer) {
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                checkOutput("seq " + inputs[i].name + " against integer reference",
+                    integer_reference[i].view(), reference[i].view(), algorithm, config,
+                    true, &counts);
+            }
+        }
+
+        if (!config.golden_dir.empty()) {
+            std::string golden_dir = config.golden_dir + "/" + goldenSet(algorithm, params);
+            if (config.update_golden) {
+                fs::create_directories(golden_dir);
+            }
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                std::string path = golden_dir + "/" + stripExtension(inputs[i].name) + ".pgm";
+                if (config.update_golden) {
+                    writePGM(path, reference[i].view());
+                    continue;
+                }
+                try {
+                    checkOutput("seq " + inputs[i].name + " against golden", readPGM(path).view(),
+                        reference[i].view(), algorithm, config, false, &counts);
+                } catch (std::runtime_error& e) {
+                    counts.record(false, "seq " + inputs[i].name + ": " + e.what());
+                }
+            }
+            if (config.update_golden) {
+                std::cout << "  Golden images written to " << golden_dir << std::endl;
+            }
+        }
+
+        for (const auto& backend_name : config.backends) {
+            long long median_ns = 0;
+            if (backend_name == "seq") {
+                median_ns = reference_ns;
+            } else if (backend_name == "omp" || backend_name == "cuda") {
+                std::vector<ImageBuffer<uint8_t>> outputs;
+                try {
+                    outputs = runInProcess(inputs, algorithm, backend_name == "omp" ?
+                        EdgeBackend::OpenMP : EdgeBackend::CUDA, params, config.reps, &median_ns);
+                } catch (std::runtime_error& e) {
+                    counts.record(false, backend_name + ": " + e.what());
+                    continue;
+                }
+                for (size_t i = 0; i < inputs.size(); ++i) {
+                    checkBackend(backend_name + " " + inputs[i].name, i, outputs[i].view());
+                }
+            } else if (backend_name == "mpi" || backend_name == "hybrid") {
+                if (!runMpiExecutable(algorithm_name, backend_name, config, &median_ns)) {
+                    counts.record(false, backend_name + ": the executable failed");
+                    continue;
+                }
+                std::string output_dir = "../" + algorithm_name + "_outputs/" + backend_name;
+                for (size_t i = 0; i < inputs.size(); ++i) {
+                    if (!inputs[i].dataset) { continue; }
+                    std::string what = backend_name + " " + inputs[i].name;
+                    try {
+                        ImageBuffer<uint8_t> output = readPGM(output_dir + "/" +
+                            stripExtension(inputs[i].name) + "_output.pgm");
+                        checkBackend(what, i, output.view());
+                    } catch (std::runtime_error& e) {
+                        counts.record(false, what + ": " + e.what());
+                    }
+                }
+            } else {
+                std::cerr << "Unknown backend [" << backend_name << "], skip" << std::endl;
+                continue;
+            }
+
+            std::string key = algorithm_name + "," + backend_name;
+            double pixels_per_s = dataset_pixels / (median_ns / 1e9);
+            throughput[key] = pixels_per_s;
+            std::ostringstream what;
+            what << backend_name << " throughput " << std::fixed << std::setprecision(1)
+                << pixels_per_s / 1e6 << " Mpixel/s";
+            auto expected = baseline.find(key);
+            if (expected == baseline.end()) {
+                std::cout << "  " << what.str() << ", no baseline" << std::endl;
+                continue;
+            }
+            double change = pixels_per_s / expected->second - 1.0;
+            what << ", baseline " << expected->second / 1e6 << " Mpixel/s ("
+                << std::showpos << change * 100.0 << "%)";
+            counts.record(change >= -config.tolerance, what.str());
+        }
+        // the next algorithm's edges have other sizes
+        reference.clear();
+        integer_reference.clear();
+        bufferPoolTrim();
+    }
+
+    if (config.update_baseline && !config.baseline_path.empty()) {
+        writeBaseline(config.baseline_path, throughput);
+        std::cout << "Baseline written to " << config.baseline_path << std::endl;
+    }
+    std::cout << counts.checks << " checks, " << counts.failures << " failed" << std::endl;
+    return counts.failures ? 1 : 0;
+}
@@ -1,8 +1,13 @@
 #ifndef SOBEL_H
 #define SOBEL_H
+#include <algorithm>
 #include <cmath>
 #include <chrono>
-#include "../gray_image.h"
+#include <iostream>
+#include <string>
+#include "../image_buffer.h"
+#include "sobel_simd.h"
+#include "sobel_int.h"
 
 namespace chrono = std::chrono;
 
@@ -26,4 +31,40 @@ inline int getOutputWidth(int width) {
     return width - 3 + 1;
 }
 
+struct SobelConfig {
+    SimdLevel simd = detectSimdLevel();
+    // uint8 pixels with integer gradients instead of floats, see sobel_int.h
+    bool integer = false;
+    // same-sized images run together, one per SIMD lane, see sobel_batch.h
+    bool batch = false;
+};
+
+// flags shared by every Sobel executable
+inline SobelConfig parseSobelArgs(int argc, char** argv, bool* verbose) {
+    SobelConfig config;
+    *verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "-v" || arg == "--verbose") {
+            *verbose = true;
+        } else if (arg == "--integer") {
+            config.integer = true;
+        } else if (arg == "--batch") {
+            config.batch = true;
+        } else if (arg.rfind("--simd=", 0) == 0) {
+            if (!parseSimdLevel(arg.substr(7), &config.simd)) {
+                std::cerr << "Unknown SIMD level [" << arg.substr(7)
+                    << "], using " << simdLevelName(config.simd) << std::endl;
+            }
+        }
+    }
+    // never ask for more than the CPU can run
+    config.simd = std::min(config.simd, detectSimdLevel());
+    if (config.batch && config.integer) {
+        std::cerr << "Batches only run the float kernels, --batch is ignored" << std::endl;
+        config.batch = false;
+    }
+    return config;
+}
+
 #endif
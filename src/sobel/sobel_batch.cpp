@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <omp.h>
+#include "sobel.h"
+#include "sobel_batch.h"
+#include "../trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SOBEL_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Computes one output row of a batch from three interleaved input rows, where
+// pixel x of lane k is at [x * lanes + k]. The arithmetic is that of the row
+// kernels in sobel_simd.cpp, so every lane is bit-exact with them
+typedef void (*SobelBatchRowKernel)(const float* row0, const float* row1,
+    const float* row2, float* output, int width);
+
+struct BatchKernel {
+    SobelBatchRowKernel row_kernel;
+    int lanes;
+};
+
+// plain loops over the lanes, which the compiler may vectorize on its own
+const int scalar_lanes = 8;
+// the lanes of an AVX-512 vector, the most any kernel below has
+const int max_lanes = 16;
+
+void sobelBatchRowScalar(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const int lanes = scalar_lanes;
+    for (int x = 0; x < width; ++x) {
+        int a = x * lanes;
+        int b = a + lanes;
+        int c = b + lanes;
+        for (int k = 0; k < lanes; ++k) {
+            float diff0 = row0[c+k] - row0[a+k];
+            float diff1 = row1[c+k] - row1[a+k];
+            float diff2 = row2[c+k] - row2[a+k];
+            float sum_x = diff0 + diff2 + (diff1 + diff1);
+
+            float top = row0[a+k] + row0[c+k] + (row0[b+k] + row0[b+k]);
+            float bottom = row2[a+k] + row2[c+k] + (row2[b+k] + row2[b+k]);
+            float sum_y = bottom - top;
+
+            float magnitude = std::sqrt(sum_x * sum_x + sum_y * sum_y);
+            output[a+k] = std::min(255.0f, magnitude);
+        }
+    }
+}
+
+#ifdef SOBEL_BATCH_X86
+
+// packed rows are aligned to 64 bytes and every pixel position is one
+// vector wide, so all loads and stores below are aligned
+
+__attribute__((target("sse4.2")))
+void sobelBatchRowSSE42(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const __m128 max_value = _mm_set1_ps(255.0f);
+    for (int x = 0; x < width; ++x) {
+        int a = x * 4;
+        __m128 a0 = _mm_load_ps(row0 + a);
+        __m128 b0 = _mm_load_ps(row0 + a + 4);
+        __m128 c0 = _mm_load_ps(row0 + a + 8);
+        __m128 a1 = _mm_load_ps(row1 + a);
+        __m128 c1 = _mm_load_ps(row1 + a + 8);
+        __m128 a2 = _mm_load_ps(row2 + a);
+        __m128 b2 = _mm_load_ps(row2 + a + 4);
+        __m128 c2 = _mm_load_ps(row2 + a + 8);
+
+        __m128 diff1 = _mm_sub_ps(c1, a1);
+        __m128 sum_x = _mm_add_ps(
+            _mm_add_ps(_mm_sub_ps(c0, a0), _mm_sub_ps(c2, a2)), _mm_add_ps(diff1, diff1));
+        __m128 top = _mm_add_ps(_mm_add_ps(a0, c0), _mm_add_ps(b0, b0));
+        __m128 bottom = _mm_add_ps(_mm_add_ps(a2, c2), _mm_add_ps(b2, b2));
+        __m128 sum_y = _mm_sub_ps(bottom, top);
+
+        __m128 magnitude = _mm_sqrt_ps(
+            _mm_add_ps(_mm_mul_ps(sum_x, sum_x), _mm_mul_ps(sum_y, sum_y)));
+        _mm_store_ps(output + a, _mm_min_ps(magnitude, max_value));
+    }
+}
+
+__attribute__((target("avx2")))
+void sobelBatchRowAVX2(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const __m256 max_value = _mm256_set1_ps(255.0f);
+    for (int x = 0; x < width; ++x) {
+        int a = x * 8;
+        __m256 a0 = _mm256_load_ps(row0 + a);
+        __m256 b0 = _mm256_load_ps(row0 + a + 8);
+        __m256 c0 = _mm256_load_ps(row0 + a + 16);
+        __m256 a1 = _mm256_load_ps(row1 + a);
+        __m256 c1 = _mm256_load_ps(row1 + a + 16);
+        __m256 a2 = _mm256_load_ps(row2 + a);
+        __m256 b2 = _mm256_load_ps(row2 + a + 8);
+        __m256 c2 = _mm256_load_ps(row2 + a + 16);
+
+        __m256 diff1 = _mm256_sub_ps(c1, a1);
+        __m256 sum_x = _mm256_add_ps(
+            _mm256_add_ps(_mm256_sub_ps(c0, a0), _mm256_sub_ps(c2, a2)),
+            _mm256_add_ps(diff1, diff1));
+        __m256 top = _mm256_add_ps(_mm256_add_ps(a0, c0), _mm256_add_ps(b0, b0));
+        __m256 bottom = _mm256_add_ps(_mm256_add_ps(a2, c2), _mm256_add_ps(b2, b2));
+        __m256 sum_y = _mm256_sub_ps(bottom, top);
+
+        __m256 magnitude = _mm256_sqrt_ps(
+            _mm256_add_ps(_mm256_mul_ps(sum_x, sum_x), _mm256_mul_ps(sum_y, sum_y)));
+        _mm256_store_ps(output + a, _mm256_min_ps(magnitude, max_value));
+    }
+}
+
+__attribute__((target("avx512f")))
+void sobelBatchRowAVX512(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const __m512 max_value = _mm512_set1_ps(255.0f);
+    for (int x = 0; x < width; ++x) {
+        int a = x * 16;
+        __m512 a0 = _mm512_load_ps(row0 + a);
+        __m512 b0 = _mm512_load_ps(row0 + a + 16);
+        __m512 c0 = _mm512_load_ps(row0 + a + 32);
+        __m512 a1 = _mm512_load_ps(row1 + a);
+        __m512 c1 = _mm512_load_ps(row1 + a + 32);
+        __m512 a2 = _mm512_load_ps(row2 + a);
+        __m512 b2 = _mm512_load_ps(row2 + a + 16);
+        __m512 c2 = _mm512_load_ps(row2 + a + 32);
+
+        __m512 diff1 = _mm512_sub_ps(c1, a1);
+        __m512 sum_x = _mm512_add_ps(
+            _mm512_add_ps(_mm512_sub_ps(c0, a0), _mm512_sub_ps(c2, a2)),
+            _mm512_add_ps(diff1, diff1));
+        __m512 top = _mm512_add_ps(_mm512_add_ps(a0, c0), _mm512_add_ps(b0, b0));
+        __m512 bottom = _mm512_add_ps(_mm512_add_ps(a2, c2), _mm512_add_ps(b2, b2));
+        __m512 sum_y = _mm512_sub_ps(bottom, top);
+
+        __m512 magnitude = _mm512_sqrt_ps(
+            _mm512_add_ps(_mm512_mul_ps(sum_x, sum_x), _mm512_mul_ps(sum_y, sum_y)));
+        _mm512_store_ps(output + a, _mm512_min_ps(magnitude, max_value));
+    }
+}
+
+#endif
+
+BatchKernel getBatchKernel(SimdLevel level) {
+    level = std::min(level, detectSimdLevel());
+#ifdef SOBEL_BATCH_X86
+    switch (level) {
+        case SimdLevel::AVX512: return {sobelBatchRowAVX512, 16};
+        case SimdLevel::AVX2: return {sobelBatchRowAVX2, 8};
+        case SimdLevel::SSE42: return {sobelBatchRowSSE42, 4};
+        case SimdLevel::Scalar: break;
+    }
+#endif
+    return {sobelBatchRowScalar, scalar_lanes};
+}
+
+// up to `lanes` images packed together, the lanes after `count` are zero
+struct Batch {
+    const ImageView<const float>* inputs;
+    const ImageView<uint8_t>* outputs;
+    int count;
+};
+
+// Interleaves row y of every image of the batch. Pixels are written in
+// order, reading one pixel of each image in turn
+void packRow(const Batch& batch, int lanes, int y, float* packed_row) {
+    const float* input_rows[max_lanes];
+    for (int k = 0; k < batch.count; ++k) {
+        input_rows[k] = batch.inputs[k][y];
+    }
+    int width = batch.inputs[0].width;
+    for (int k = 0; k < batch.count; ++k) {
+        const float* input_row = input_rows[k];
+        for (int x = 0; x < width; ++x) {
+            packed_row[x * lanes + k] = input_row[x];
+        }
+    }
+    for (int k = batch.count; k < lanes; ++k) {
+        for (int x = 0; x < width; ++x) {
+            packed_row[x * lanes + k] = 0.0f;
+        }
+    }
+}
+
+// Output rows [start_y, end_y) of a batch. Input rows are packed just before
+// the kernel reads them into a ring of three rows, so the packed pixels are
+// still in L1 when they are used and a batch never exists packed as a whole
+void sobelBatchRows(const Batch& batch, BatchKernel kernel, int start_y, int end_y) {
+    if (start_y >= end_y) { return; }
+    int lanes = kernel.lanes;
+    int width = batch.outputs[0].width;
+    int packed_width = batch.inputs[0].width * lanes;
+    // three packed input rows and one packed output row, which the thread's
+    // pool cache hands back on the next call
+    ImageBuffer<float> rows(packed_width, 4);
+    float* output = rows[3];
+
+    packRow(batch, lanes, start_y, rows[start_y % 3]);
+    packRow(batch, lanes, start_y + 1, rows[(start_y + 1) % 3]);
+    for (int y = start_y; y < end_y; ++y) {
+        packRow(batch, lanes, y + 2, rows[(y + 2) % 3]);
+        kernel.row_kernel(rows[y % 3], rows[(y + 1) % 3], rows[(y + 2) % 3], output, width);
+
+        uint8_t* output_rows[max_lanes];
+        for (int k = 0; k < batch.count; ++k) {
+            output_rows[k] = batch.outputs[k][y];
+        }
+        for (int k = 0; k < batch.count; ++k) {
+            uint8_t* output_row = output_rows[k];
+            for (int x = 0; x < width; ++x) {
+                output_row[x] = (uint8_t)output[x * lanes + k];
+            }
+        }
+    }
+}
+
+// output rows per (batch, row block) pair of the flattened schedule, each
+// block packs two rows more than it computes
+const int batch_block_rows = 32;
+
+}
+
+int sobelBatchLanes(SimdLevel level) {
+    return getBatchKernel(level).lanes;
+}
+
+void sobelBatchCPU(const std::vector<ImageView<const float>>& inputs,
+    const std::vector<ImageView<uint8_t>>& outputs, SimdLevel level,
+    BatchSchedule schedule, bool parallel
+) {
+    TRACE_SCOPE("sobelBatch");
+    if (inputs.empty()) { return; }
+    int width = inputs[0].width;
+    int height = inputs[0].height;
+    int output_height = getOutputHeight(height);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (inputs[i].width != width || inputs[i].height != height) {
+            throw std::runtime_error("Images of a batch must all be " +
+                std::to_string(width) + "x" + std::to_string(height));
+        }
+        if (i >= outputs.size() || outputs[i].width != getOutputWidth(width) ||
+                outputs[i].height != output_height) {
+            throw std::runtime_error("Edge images of a batch must all be " +
+                std::to_string(getOutputWidth(width)) + "x" + std::to_string(output_height));
+        }
+    }
+
+    BatchKernel kernel = getBatchKernel(level);
+    int lanes = kernel.lanes;
+    int image_count = (int)inputs.size();
+    int batch_count = (image_count + lanes - 1) / lanes;
+    auto batchAt = [&](int b) {
+        return Batch{&inputs[b * lanes], &outputs[b * lanes],
+            std::min(lanes, image_count - b * lanes)};
+    };
+
+    int threads = parallel ? omp_get_max_threads() : 1;
+    if (schedule == BatchSchedule::Flattened) {
+        int blocks = (output_height + batch_block_rows - 1) / batch_block_rows;
+
+        #pragma omp parallel for collapse(2) schedule(dynamic) if (threads > 1)
+        for (int b = 0; b < batch_count; ++b) {
+            for (int block = 0; block < blocks; ++block) {
+                int start_y = block * batch_block_rows;
+                sobelBatchRows(batchAt(b), kernel, start_y,
+                    std::min(output_height, start_y + batch_block_rows));
+            }
+        }
+        return;
+    }
+
+    // threads left over once every batch has one go to the rows of each batch
+    int outer = std::max(1, std::min(threads, batch_count));
+    int inner = std::max(1, threads / outer);
+
+    #pragma omp parallel for num_threads(outer) schedule(dynamic) if (outer > 1)
+    for (int b = 0; b < batch_count; ++b) {
+        Batch batch = batchAt(b);
+
+        #pragma omp parallel for num_threads(inner) if (inner > 1)
+        for (int i = 0; i < inner; ++i) {
+            sobelBatchRows(batch, kernel, (int)((long)output_height * i / inner),
+                (int)((long)output_height * (i + 1) / inner));
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef SOBEL_BATCH_H
+#define SOBEL_BATCH_H
+#include <cstdint>
+#include <vector>
+#include "../image_buffer.h"
+#include "sobel_simd.h"
+
+// How sobelBatchCPU shares the batches among the OpenMP threads
+enum class BatchSchedule {
+    // An outer team over the batches and, when there are fewer batches than
+    // threads, an inner team per batch over its rows. Inner teams only get
+    // threads once nested parallelism is enabled (omp_set_max_active_levels)
+    Nested,
+    // one loop over every (batch, row) pair
+    Flattened
+};
+
+// images per batch, one per lane of the widest float vector at `level`
+int sobelBatchLanes(SimdLevel level);
+
+// Sobel over many images of the same size at once. Each group of
+// sobelBatchLanes images is packed into one interleaved float image that
+// holds pixel (x, y) of every image of the group side by side, so one vector
+// load fetches the same pixel of all of them, and the row loop with its setup
+// and tail runs once per batch instead of once per image. Meant for
+// thumbnails, where that per-image work costs as much as the pixels.
+// outputs[i] gets the edges of inputs[i], identical to sobelCPU. Throws
+// std::runtime_error if the inputs differ in size or an output is not
+// getOutputWidth/Height of them
+void sobelBatchCPU(const std::vector<ImageView<const float>>& inputs,
+    const std::vector<ImageView<uint8_t>>& outputs, SimdLevel level,
+    BatchSchedule schedule, bool parallel);
+
+#endif
@@ -0,0 +1,36 @@
+#include <vector>
+#include "sobel_cpu.h"
+#include "../trace.h"
+
+void sobelCPU(ImageView<const float> input, ImageView<uint8_t> output,
+    SobelRowKernel row_kernel, bool parallel
+) {
+    TRACE_SCOPE("sobel");
+    int new_width = output.width;
+
+    #pragma omp parallel for if (parallel)
+    for (int y = 0; y < output.height; ++y) {
+        // the row kernels write floats, one row of them per thread is enough
+        thread_local std::vector<float> row;
+        row.resize(new_width);
+        row_kernel(input[y], input[y+1], input[y+2], row.data(), new_width);
+
+        uint8_t* output_row = output[y];
+        for (int x = 0; x < new_width; ++x) {
+            output_row[x] = (uint8_t)row[x];
+        }
+    }
+}
+
+void sobelIntegerCPU(ImageView<const uint8_t> input, ImageView<uint8_t> output, bool parallel) {
+    TRACE_SCOPE("sobel");
+    if (!parallel) {
+        sobelIntegerRows(input, output, 0, output.height);
+        return;
+    }
+
+    #pragma omp parallel for
+    for (int y = 0; y < output.height; ++y) {
+        sobelIntegerRows(input, output, y, y + 1);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef SOBEL_CPU_H
+#define SOBEL_CPU_H
+#include "sobel.h"
+
+// Sobel over a whole image on the CPU. Output is getOutputWidth/Height of the
+// input and holds the clamped magnitude as uint8, truncated like a saved
+// image. With `parallel`, rows are shared among the OpenMP threads, otherwise
+// everything runs on the calling thread.
+void sobelCPU(ImageView<const float> input, ImageView<uint8_t> output,
+    SobelRowKernel row_kernel, bool parallel);
+
+// same for the integer kernel, see sobel_int.h
+void sobelIntegerCPU(ImageView<const uint8_t> input, ImageView<uint8_t> output, bool parallel);
+
+#endif
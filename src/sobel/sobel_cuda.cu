@@ -1,9 +1,8 @@
-#include "sobel.h"
-#include <chrono>
-#include <iostream>
+#include <stdexcept>
+#include <string>
 #include <cuda_runtime.h>
-
-namespace chrono = std::chrono;
+#include "sobel_cuda.h"
+#include "../trace.h"
 
 __constant__ int d_kernel_x[3][3] = {
     {-1, 0, 1},
@@ -17,7 +16,7 @@ __constant__ int d_kernel_y[3][3] = {
     {1, 2, 1}
 };
 
-__global__ void sobelKernel(float* input, float* output, int width, int height) {
+__global__ void sobelKernel(float* input, uint8_t* output, int width, int height) {
     int x = blockIdx.x * blockDim.x + threadIdx.x;
     int y = blockIdx.y * blockDim.y + threadIdx.y;
     int new_width = width - 2;
@@ -38,41 +37,36 @@ __global__ void sobelKernel(float* input, float* output, int width, int height)
     }
 
     float magnitude = sqrtf(sum_x * sum_x + sum_y * sum_y);
-    output[(y - 1) * new_width + (x - 1)] = fminf(255.0f, magnitude);
+    // truncated to uint8 on the device, so only a quarter of the bytes come back
+    output[(y - 1) * new_width + (x - 1)] = (uint8_t)fminf(255.0f, magnitude);
 }
 
-void sobelCUDA(GrayImage* image) {
-    int width = image->width;
-    int height = image->height;
+void sobelCUDA(ImageView<const float> input, ImageView<uint8_t> output) {
+    TRACE_SCOPE("sobel");
+    int width = input.width;
+    int height = input.height;
     int size = width * height * sizeof(float);
-    int new_size = (width-2) * (height-2) * sizeof(float);
+    int new_size = (width-2) * (height-2) * sizeof(uint8_t);
 
     float* d_input;
-    float* d_output;
-    float* input = new float[size];
-    float* result = new float[new_size];
-
-    for(int i = 0; i < height; i++) {
-	memcpy(input+i*width, image->image[i], width*sizeof(float));
-    }
+    uint8_t* d_output;
 
     // Error checking for cudaMalloc
     if (cudaMalloc(&d_input, size) != cudaSuccess) {
-        std::cerr << "Failed to allocate device memory for input." << std::endl;
-        return;
+        throw std::runtime_error("Failed to allocate device memory for input");
     }
     if (cudaMalloc(&d_output, new_size) != cudaSuccess) {
-        std::cerr << "Failed to allocate device memory for output." << std::endl;
         cudaFree(d_input);
-        return;
+        throw std::runtime_error("Failed to allocate device memory for output");
     }
 
-    // Error checking for cudaMemcpy
-    if (cudaMemcpy(d_input, input, size, cudaMemcpyHostToDevice) != cudaSuccess) {
-        std::cerr << "Failed to copy data to device memory." << std::endl;
+    // Error checking for cudaMemcpy. Host rows are padded, device rows are packed
+    if (cudaMemcpy2D(d_input, width * sizeof(float),
+            input.data, input.stride * sizeof(float),
+            width * sizeof(float), height, cudaMemcpyHostToDevice) != cudaSuccess) {
         cudaFree(d_input);
         cudaFree(d_output);
-        return;
+        throw std::runtime_error("Failed to copy data to device memory");
     }
 
     dim3 blockSize(16, 16);
@@ -84,65 +78,23 @@ void sobelCUDA(GrayImage* image) {
     // Error checking for kernel launch
     cudaError_t err = cudaGetLastError();
     if (err != cudaSuccess) {
-        std::cerr << "Kernel launch failed: " << cudaGetErrorString(err) << std::endl;
         cudaFree(d_input);
         cudaFree(d_output);
-        return;
+        throw std::runtime_error(std::string("Kernel launch failed: ") +
+            cudaGetErrorString(err));
     }
 
     // Error checking for cudaMemcpy
-    if (cudaMemcpy(result, d_output, new_size, cudaMemcpyDeviceToHost) != cudaSuccess) {
-        std::cerr << "Failed to copy data from device memory." << std::endl;
-    }
     int new_height = height - 2;
     int new_width = width - 2;
-    for(int i = 0; i < new_height; i++) {
-	memcpy(image->image[i], result+i*new_width, new_width*sizeof(float));
-    }
+    err = cudaMemcpy2D(output.data, output.stride * sizeof(uint8_t),
+        d_output, new_width * sizeof(uint8_t),
+        new_width * sizeof(uint8_t), new_height, cudaMemcpyDeviceToHost);
 
     cudaFree(d_input);
     cudaFree(d_output);
 
-    image->width = width - 2;
-    image->height = height - 2;
-}
-
-int main(int argc, char** argv) {
-    bool verbose = false;
-    if (argc > 1) {
-        auto arg1 = std::string(argv[1]);
-        if (arg1 == "-v" || arg1 == "--verbose") {
-            verbose = true;
-        }
-    }
-
-    std::cout << "========== CUDA Sobel ==========" << std::endl;
-    std::cout << "Loading images..." << std::endl;
-
-    std::vector<GrayImage*> images = getBSDS500Images(verbose);
-
-    std::cout << "Start processing images..." << std::endl;
-
-    auto start = chrono::high_resolution_clock::now();
-    for (auto& image : images) {
-        if (verbose) {
-            std::cout << "Processing image ["
-                << image->file_name << "]..." << std::endl;
-        }
-        sobelCUDA(image);
-
-        image->saveImage("../sobel_outputs/cuda");
-        if (verbose) {
-            std::cout << "Saved output of image [" 
-                << image->file_name << "] successfully" << std::endl;
-        }
-        delete image;
+    if (err != cudaSuccess) {
+        throw std::runtime_error("Failed to copy data from device memory");
     }
-    auto end = chrono::high_resolution_clock::now();
-
-    auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
-    std::cout << "Duration: " << duration.count() << " ns" << std::endl;
-
-    return 0;
 }
-
@@ -0,0 +1,9 @@
+#ifndef SOBEL_CUDA_H
+#define SOBEL_CUDA_H
+#include "sobel.h"
+
+// Sobel on the GPU, same output as sobelCPU. Throws std::runtime_error when
+// a CUDA call fails
+void sobelCUDA(ImageView<const float> input, ImageView<uint8_t> output);
+
+#endif
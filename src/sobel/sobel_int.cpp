@@ -0,0 +1,62 @@
+#include <cmath>
+#include "sobel.h"
+#include "sobel_int.h"
+
+// largest r with r * r <= value
+static int integerSqrt(int value) {
+    int root = 0;
+    for (int bit = 1 << 15; bit > 0; bit >>= 1) {
+        int candidate = root | bit;
+        if (candidate * candidate <= value) {
+            root = candidate;
+        }
+    }
+    return root;
+}
+
+void sobelIntegerRows(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    int start_y, int end_y
+) {
+    const int max_squared = 255 * 255;
+    int width = output.width;
+
+    for (int y = start_y; y < end_y; ++y) {
+        const uint8_t* row0 = input[y];
+        const uint8_t* row1 = input[y+1];
+        const uint8_t* row2 = input[y+2];
+        uint8_t* output_row = output[y];
+
+        for (int x = 0; x < width; ++x) {
+            // |gx|, |gy| <= 4 * 255, so both fit in int16
+            int16_t diff1 = row1[x+2] - row1[x];
+            int16_t sum_x = (row0[x+2] - row0[x]) + (row2[x+2] - row2[x]) + (diff1 << 1);
+            int16_t sum_y = (row2[x] + row2[x+2] + (row2[x+1] << 1)) -
+                (row0[x] + row0[x+2] + (row0[x+1] << 1));
+
+            // squares need int32. Below 255^2 the float square root of an
+            // integer never rounds up to the next integer, so truncating it
+            // gives the exact integer square root
+            int32_t squared = (int32_t)sum_x * sum_x + (int32_t)sum_y * sum_y;
+            output_row[x] = squared >= max_squared ?
+                255 : (uint8_t)std::sqrt((float)squared);
+        }
+    }
+}
+
+void sobelIntegerReference(ImageView<const uint8_t> input, ImageView<uint8_t> output) {
+    for (int y = 0; y < output.height; ++y) {
+        for (int x = 0; x < output.width; ++x) {
+            int sum_x = 0;
+            int sum_y = 0;
+            for (int i = 0; i < 3; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    sum_x += kernel_x[i][j] * input[y+i][x+j];
+                    sum_y += kernel_y[i][j] * input[y+i][x+j];
+                }
+            }
+
+            int magnitude = integerSqrt(sum_x * sum_x + sum_y * sum_y);
+            output[y][x] = (uint8_t)std::min(255, magnitude);
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef SOBEL_INT_H
+#define SOBEL_INT_H
+#include <cstdint>
+#include "../image_buffer.h"
+
+// Integer Sobel: uint8 pixels in, int16 gradients, uint8 magnitude out.
+// Writes output rows [start_y, end_y), output row y reads input rows y..y+2.
+// Bit-exact with the float kernels on the same pixels.
+void sobelIntegerRows(ImageView<const uint8_t> input, ImageView<uint8_t> output,
+    int start_y, int end_y);
+
+// Plain kernel_x/kernel_y loops with an integer square root, kept as the
+// reference sobelIntegerRows is checked against
+void sobelIntegerReference(ImageView<const uint8_t> input, ImageView<uint8_t> output);
+
+#endif
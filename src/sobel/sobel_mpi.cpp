@@ -1,43 +1,83 @@
-#include <cstring>
 #include <mpi.h>
 #include "sobel.h"
+#include "../image_cache.h"
+#include "../mpi_dispatch.h"
+#include "../mpi_output.h"
+#include "../mpi_overlap.h"
+#include "../mpi_scatter.h"
+#include "../mpi_threads.h"
+#include "../trace.h"
 
-void sobelMPI(GrayImage* image, int rank, int size) {
-    int height = image->height;
-    int width = image->width;
+// Rank 0 passes the image it decoded as uint8 and gets the result back in
+// it, the other ranks pass nullptr and receive their rows from rank 0. With a
+// shared_path, nothing is gathered: every rank writes its rows into the PGM
+// there and image is left as it was. Returns false on every rank when there
+// are no edges to save: rank 0 failed to decode the image or it is too small
+// for the kernel
+bool sobelMPI(GrayImage* image, MPI_Comm comm, SobelRowKernel row_kernel,
+    const std::string& shared_path, MpiWaitTimes* wait_times
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int width, height;
+    broadcastImageSize(image, comm, &width, &height);
+    if (width == 0) { return false; }
     int new_height = getOutputHeight(height);
     int new_width = getOutputWidth(width);
+    if (new_width <= 0 || new_height <= 0) {
+        skipSmallImage(image, width, height, comm);
+        return false;
+    }
 
     int rows_per_process = new_height / size;
     int start_y = rank * rows_per_process;
     int end_y = (rank == size - 1) ? new_height : start_y + rows_per_process;
     int local_height = end_y - start_y;
-    float* local_new_image = new float[local_height * new_width];
+    ImageBuffer<float> local_new_image(new_width, local_height);
 
-    for (int y = start_y; y < end_y; ++y) {
-        for (int x = 0; x < new_width; ++x) {
-            float sum_x = 0;
-            float sum_y = 0;
+    // input row 0 is global row start_y
+    ImageBuffer<uint8_t> local_pixels;
+    ImageView<const uint8_t> pixels;
+    timeWait(&wait_times->scatter, [&]() {
+        pixels = scatterRows(image ? image->pixelView() : ImageView<const uint8_t>(),
+            width, height, rows_per_process, 2, &local_pixels, comm);
+    });
+    ImageBuffer<float> input = widenPixels(pixels, rankThreads() > 1);
+
+    parallelRows(0, local_height, [&](int from_y, int to_y) {
+        TRACE_SCOPE("sobel");
+        for (int y = from_y; y < to_y; ++y) {
+            float* output_row = local_new_image[y];
+            row_kernel(input[y], input[y+1], input[y+2], output_row, new_width);
+        }
+    });
 
-            for (int i = 0; i < 3; ++i) {
-                for (int j = 0; j < 3; ++j) {
-                    sum_x += kernel_x[i][j] * image->image[y+i][x+j];
-                    sum_y += kernel_y[i][j] * image->image[y+i][x+j];
+    if (!shared_path.empty()) {
+        // saved images hold the results truncated to uint8, as saveImage does
+        ImageBuffer<uint8_t> local_pixels_out(new_width, local_height);
+        parallelRows(0, local_height, [&](int from_y, int to_y) {
+            for (int y = from_y; y < to_y; ++y) {
+                const float* src = local_new_image[y];
+                uint8_t* dest = local_pixels_out[y];
+                for (int x = 0; x < new_width; ++x) {
+                    dest[x] = (uint8_t)src[x];
                 }
             }
-
-            sum_x = std::abs(sum_x);
-            sum_y = std::abs(sum_y);
-
-            int fill_idx = (y - start_y) * new_width + x;
-            float magnitude = std::sqrt(sum_x * sum_x + sum_y * sum_y);
-            local_new_image[fill_idx] = std::min(255.0f, magnitude);
-        }
+        });
+        timeWait(&wait_times->save, [&]() {
+            writeRowsPGM(shared_path, local_pixels_out.view(), new_width, new_height,
+                start_y, comm);
+        });
+        return true;
     }
 
-    float* linear_new_image = nullptr;
+    // local and gathered buffers share the same row stride, so padded rows
+    // can be gathered as-is without repacking
+    int stride = local_new_image.stride;
+    ImageBuffer<float> new_image;
     if (rank == 0) {
-        linear_new_image = new float[new_height * new_width];
+        new_image = ImageBuffer<float>(new_width, new_height);
     }
 
     int recv_counts[size];
@@ -45,9 +85,9 @@ void sobelMPI(GrayImage* image, int rank, int size) {
     if (rank == 0) {
         for (int i = 0; i < size; ++i) {
             if (i == size - 1) {
-                recv_counts[i] = (new_height - (rows_per_process * i)) * new_width;
+                recv_counts[i] = (new_height - (rows_per_process * i)) * stride;
             } else {
-                recv_counts[i] = rows_per_process * new_width;
+                recv_counts[i] = rows_per_process * stride;
             }
 
             if (i == 0) {
@@ -58,84 +98,232 @@ void sobelMPI(GrayImage* image, int rank, int size) {
         }
     }
 
-    MPI_Gatherv(local_new_image, (local_height * new_width), MPI_FLOAT,
-        linear_new_image, recv_counts, displs, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    timeWait(&wait_times->gather, [&]() {
+        TRACE_SCOPE("MPI_Gatherv");
+        MPI_Gatherv(local_new_image.data, (local_height * stride), MPI_FLOAT,
+            new_image.data, recv_counts, displs, MPI_FLOAT, 0, comm);
+    });
 
-    float** new_image = new float*[new_height];
     if (rank == 0) {
-        for (int y = 0; y < new_height; ++y) {
-            new_image[y] = new float[new_width];
-            std::memcpy(new_image[y], 
-                &linear_new_image[y * new_width], new_width * sizeof(float));
-        }
+        image->assign(std::move(new_image));
     }
+    return true;
+}
 
-    delete[] local_new_image;
-    delete[] linear_new_image;
+// same calling convention as sobelMPI
+bool sobelIntegerMPI(GrayImage* image, MPI_Comm comm, const std::string& shared_path,
+    MpiWaitTimes* wait_times
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int width, height;
+    broadcastImageSize(image, comm, &width, &height);
+    if (width == 0) { return false; }
+    int new_height = getOutputHeight(height);
+    int new_width = getOutputWidth(width);
+    if (new_width <= 0 || new_height <= 0) {
+        skipSmallImage(image, width, height, comm);
+        return false;
+    }
 
+    int rows_per_process = new_height / size;
+    int start_y = rank * rows_per_process;
+    int end_y = (rank == size - 1) ? new_height : start_y + rows_per_process;
+    int local_height = end_y - start_y;
+    ImageBuffer<uint8_t> local_new_image(new_width, local_height);
+
+    // input row 0 is global row start_y, so local output row 0 reads from it
+    ImageBuffer<uint8_t> local_pixels;
+    ImageView<const uint8_t> local_input;
+    timeWait(&wait_times->scatter, [&]() {
+        local_input = scatterRows(image ? image->pixelView() : ImageView<const uint8_t>(),
+            width, height, rows_per_process, 2, &local_pixels, comm);
+    });
+    parallelRows(0, local_height, [&](int from_y, int to_y) {
+        TRACE_SCOPE("sobel");
+        sobelIntegerRows(local_input, local_new_image.view(), from_y, to_y);
+    });
+
+    if (!shared_path.empty()) {
+        timeWait(&wait_times->save, [&]() {
+            writeRowsPGM(shared_path, local_new_image.view(), new_width, new_height,
+                start_y, comm);
+        });
+        return true;
+    }
+
+    int stride = local_new_image.stride;
+    ImageBuffer<uint8_t> new_image;
+    if (rank == 0) {
+        new_image = ImageBuffer<uint8_t>(new_width, new_height);
+    }
+
+    int recv_counts[size];
+    int displs[size];
     if (rank == 0) {
-        for (int i = 0; i < height; ++i) {
-            delete[] image->image[i];
+        for (int i = 0; i < size; ++i) {
+            if (i == size - 1) {
+                recv_counts[i] = (new_height - (rows_per_process * i)) * stride;
+            } else {
+                recv_counts[i] = rows_per_process * stride;
+            }
+
+            if (i == 0) {
+                displs[i] = 0;
+            } else {
+                displs[i] = displs[i-1] + recv_counts[i-1];
+            }
         }
-        delete[] image->image;
+    }
+
+    timeWait(&wait_times->gather, [&]() {
+        TRACE_SCOPE("MPI_Gatherv");
+        MPI_Gatherv(local_new_image.data, (local_height * stride), MPI_UINT8_T,
+            new_image.data, recv_counts, displs, MPI_UINT8_T, 0, comm);
+    });
 
-        image->image = new_image;
-        image->height = new_height;
-        image->width = new_width;
+    if (rank == 0) {
+        image->assign(std::move(new_image));
     }
+    return true;
 }
 
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    initMpiThreads(&argc, &argv);
 
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
     bool verbose = false;
-    if (argc > 1) {
-        auto arg1 = std::string(argv[1]);
-        if (arg1 == "-v" || arg1 == "--verbose") {
-            verbose = true;
+    SobelConfig config = parseSobelArgs(argc, argv, &verbose);
+    MpiDistribution distribution = parseMpiDistribution(argc, argv);
+    bool overlap = parseMpiOverlapArg(argc, argv);
+    MpiOutput output = parseMpiOutput(argc, argv);
+    int threads = parseRankThreadsArg(argc, argv);
+    std::string trace_path = parseTraceArg(argc, argv);
+    // the hybrid executables are these sources built with OpenMP
+    std::string backend = hybrid_build ? "hybrid" : "mpi";
+
+    if (rank == 0) {
+        std::cout << "==========" << (hybrid_build ? "Hybrid" : "MPI")
+            << " Sobel==========" << std::endl;
+        std::cout << "Using " << (config.integer ? "integer" : simdLevelName(config.simd))
+            << " kernel" << std::endl;
+        std::cout << "Distributing " << (distribution == MpiDistribution::Images ?
+            "whole images" : "image rows") << " to ranks" << std::endl;
+        if (overlap) {
+            std::cout << "Overlapping communication and saving with compute" << std::endl;
+        }
+        if (output == MpiOutput::SharedFile) {
+            std::cout << "Writing output with MPI-IO" << std::endl;
         }
     }
-
+    setupRankThreads(threads, MPI_COMM_WORLD, verbose);
     if (rank == 0) {
-        std::cout << "==========MPI Sobel==========" << std::endl;
         std::cout << "Loading images..." << std::endl;
     }
 
-    std::vector<GrayImage*> images = getBSDS500Images(verbose);
+    // images are decoded as uint8, the float kernels widen the rows they compute on
+    PixelFormat format = PixelFormat::UInt8;
+    // rank 0 builds a missing cache before the other ranks map it
+    std::string cache_path = parseImageCacheArg(argc, argv);
+    ImageCache cache;
+    std::vector<ImageSource> sources;
+    if (rank == 0) {
+        sources = listDatasetImages(cache_path, &cache, verbose);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank != 0) {
+        sources = listDatasetImages(cache_path, &cache, verbose);
+    }
+
+    MpiWaitTimes wait_times;
+    SobelRowKernel row_kernel = getSobelRowKernel(config.simd);
+    auto sobel = [&](GrayImage* image, MPI_Comm comm, const std::string& shared_path) {
+        if (config.integer) {
+            return sobelIntegerMPI(image, comm, shared_path, &wait_times);
+        }
+        return sobelMPI(image, comm, row_kernel, shared_path, &wait_times);
+    };
 
     if (rank == 0) {
         std::cout << "Start processing images..." << std::endl;
     }
 
+    std::string output_dir = "../sobel_outputs/" + backend;
+    ImageSaver saver(output_dir, overlap, verbose);
+    bool shared_file = output == MpiOutput::SharedFile;
+    if (shared_file) {
+        createOutputDirectory(output_dir, MPI_COMM_WORLD);
+    }
     MPI_Barrier(MPI_COMM_WORLD);
+    if (!trace_path.empty()) {
+        traceStart(rank, "Rank " + std::to_string(rank));
+    }
     auto start = chrono::high_resolution_clock::now();
-    for (auto& image : images) {
-        std::string message = "Processing image [" + image->file_name + "]...";
-        if (verbose && rank == 0) {
-            std::cout << "Processing image ["
-                << image->file_name << "]..." << std::endl;
+    if (distribution == MpiDistribution::Images) {
+        // each rank decodes only the images it is dealt
+        int processed = distributeImages(sources.size(), MPI_COMM_WORLD, [&](int index) {
+            for (auto& image : loadImages({sources[index]}, verbose, format)) {
+                if (verbose) {
+                    std::cout << "Processing image [" << image->file_name
+                        << "] on rank " << rank << "..." << std::endl;
+                }
+                if (shared_file) {
+                    // every rank writes its own files, as the only rank of the file
+                    sobel(image, MPI_COMM_SELF, pgmOutputPath(output_dir, image->file_name));
+                    delete image;
+                } else if (sobel(image, MPI_COMM_SELF, "")) {
+                    saver.save(image, &wait_times);
+                } else {
+                    delete image;
+                }
+            }
+        });
+        if (verbose) {
+            std::cout << "Rank " << rank << " processed " << processed
+                << " images" << std::endl;
         }
-        sobelMPI(image, rank, size);
+    } else {
+        // only rank 0 decodes, the other ranks get their rows from it
+        for (size_t i = 0; i < sources.size(); ++i) {
+            GrayImage* image = nullptr;
+            if (rank == 0) {
+                std::vector<GrayImage*> loaded = loadImages({sources[i]}, verbose, format);
+                image = loaded.empty() ? nullptr : loaded[0];
+            }
+            if (verbose && image) {
+                std::cout << "Processing image ["
+                    << image->file_name << "]..." << std::endl;
+            }
+            // every rank knows the file name, even if rank 0 fails to decode it
+            std::string shared_path = shared_file ?
+                pgmOutputPath(output_dir, sources[i].file_name) : "";
+            bool done = sobel(image, MPI_COMM_WORLD, shared_path);
 
-        if (rank == 0) {
-            image->saveImage("../sobel_outputs/mpi");
-            if (verbose) {
-                std::cout << "Saved output of image [" 
-                    << image->file_name << "] successfully" << std::endl;
+            if (image && (shared_file || !done)) {
+                delete image;
+            } else if (image) {
+                saver.save(image, &wait_times);
             }
         }
-        delete image;
     }
+    saver.finish(&wait_times);
     MPI_Barrier(MPI_COMM_WORLD);
 
     if (rank == 0) {
         auto end = chrono::high_resolution_clock::now();
         auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
         std::cout << "Duration: " << duration.count() << " ns" << std::endl;
+        BufferPoolStats pool_stats = bufferPoolStats();
+        std::cout << "Image buffers: " << pool_stats.heap_allocations << " allocated, "
+            << pool_stats.reuses << " reused" << std::endl;
+    }
+    reportWaitTimes(wait_times, MPI_COMM_WORLD);
+    if (!trace_path.empty()) {
+        writeTraceMPI(trace_path, MPI_COMM_WORLD);
     }
 
     MPI_Finalize();
@@ -1,79 +1,64 @@
 #include "sobel.h"
-#include <omp.h>
-
-void sobelOpenMP(GrayImage* image) {
-    int height = image->height;
-    int width = image->width;
-    int new_height = getOutputHeight(height);
-    int new_width = getOutputWidth(width);
-    float** new_image = new float*[new_height];
-
-    #pragma omp parallel for
-    for (int y = 0; y < new_height; ++y) {
-        new_image[y] = new float[new_width];
-        for (int x = 0; x < new_width; ++x) {
-            float sum_x = 0;
-            float sum_y = 0;
-
-            for (int i = 0; i < 3; ++i) {
-                for (int j = 0; j < 3; ++j) {
-                    sum_x += kernel_x[i][j] * image->image[y+i][x+j];
-                    sum_y += kernel_y[i][j] * image->image[y+i][x+j];
-                }
-            }
-
-            sum_x = std::abs(sum_x);
-            sum_y = std::abs(sum_y);
-
-            float magnitude = std::sqrt(sum_x * sum_x + sum_y * sum_y);
-            new_image[y][x] = std::min(255.0f, magnitude);
-        }
-    }
-
-    for (int i = 0; i < image->height; ++i) {
-        delete[] image->image[i];
-    }
-    delete[] image->image;
-
-    image->image = new_image;
-    image->height = new_height;
-    image->width = new_width;
-}
+#include "sobel_batch.h"
+#include "../image_cache.h"
+#include "../pipeline.h"
+#include "../trace.h"
 
 int main(int argc, char** argv) {
     bool verbose = false;
-    if (argc > 1) {
-        auto arg1 = std::string(argv[1]);
-        if (arg1 == "-v" || arg1 == "--verbose") {
-            verbose = true;
-        }
-    }
+    SobelConfig config = parseSobelArgs(argc, argv, &verbose);
+    PipelineConfig pipeline_config = parsePipelineArgs(argc, argv);
+    std::string cache_path = parseImageCacheArg(argc, argv);
+    std::string trace_path = parseTraceArg(argc, argv);
     
     std::cout << "==========OpenMP Sobel==========" << std::endl;
+    std::cout << "Using " << (config.integer ? "integer" : simdLevelName(config.simd))
+        << " kernel" << std::endl;
+    if (config.batch) {
+        std::cout << "Batches of " << sobelBatchLanes(config.simd) << " images" << std::endl;
+    }
     std::cout << "Loading images..." << std::endl;
-    std::vector<GrayImage*> images = getBSDS500Images(verbose);
+    PixelFormat format = config.integer ? PixelFormat::UInt8 : PixelFormat::Float32;
+    ImageCache cache;
+    std::vector<ImageSource> sources = listDatasetImages(cache_path, &cache, verbose);
+    EdgeParams params;
+    params.sobel = config;
 
     std::cout << "Start processing images..." << std::endl;
+    traceStart(0, "OpenMP Sobel");
     auto start = chrono::high_resolution_clock::now();
-    #pragma omp parallel for
-    for (auto& image : images) {
-        if (verbose) {
-            std::cout << "Processing image ["
-                << image->file_name << "]..." << std::endl;
-        }
-        sobelOpenMP(image);
+    ImagePipeline pipeline(sources, format, "../sobel_outputs/openmp",
+        pipeline_config, verbose);
+    #pragma omp parallel
+    {
+        if (config.batch) {
+            processBatches(&pipeline, config, verbose);
+        } else {
+            // Images already run side by side, one per thread. The OpenMP
+            // backend would open a nested parallel region per image, which
+            // runs on this thread alone anyway while nesting is disabled
+            while (GrayImage* image = pipeline.next()) {
+                if (verbose) {
+                    std::cout << "Processing image ["
+                        << image->file_name << "]..." << std::endl;
+                }
+                detectEdges(image, EdgeAlgorithm::Sobel, EdgeBackend::Sequential, params);
 
-        image->saveImage("../sobel_outputs/openmp");
-        if (verbose) {
-            std::cout << "Saved output of image [" 
-                << image->file_name << "] successfully" << std::endl;
+                pipeline.done(image);
+            }
         }
-        delete image;
     }
+    pipeline.finish();
     auto end = chrono::high_resolution_clock::now();
 
     auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start);
     std::cout << "Duration: " << duration.count() << " ns" << std::endl;
+    BufferPoolStats pool_stats = bufferPoolStats();
+    std::cout << "Image buffers: " << pool_stats.heap_allocations << " allocated, "
+        << pool_stats.reuses << " reused" << std::endl;
+    if (!trace_path.empty()) {
+        writeTrace(trace_path);
+    }
 
     return 0;
 }
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cmath>
+#include "sobel_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SOBEL_X86 1
+#include <immintrin.h>
+#endif
+
+// The taps are fixed at +-1 and +-2, so both gradients are written as adds and
+// a doubling instead of multiplying by the kernel tables. Input pixels are
+// whole numbers and the squared gradients stay below 2^24, so every step is
+// exact in float whatever the order (or FMA contraction) and all kernels below
+// are bit-exact with each other and with the kernel_x/kernel_y loops.
+
+static void sobelRowScalar(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    for (int x = 0; x < width; ++x) {
+        float diff0 = row0[x+2] - row0[x];
+        float diff1 = row1[x+2] - row1[x];
+        float diff2 = row2[x+2] - row2[x];
+        float sum_x = diff0 + diff2 + (diff1 + diff1);
+
+        float top = row0[x] + row0[x+2] + (row0[x+1] + row0[x+1]);
+        float bottom = row2[x] + row2[x+2] + (row2[x+1] + row2[x+1]);
+        float sum_y = bottom - top;
+
+        float magnitude = std::sqrt(sum_x * sum_x + sum_y * sum_y);
+        output[x] = std::min(255.0f, magnitude);
+    }
+}
+
+#ifdef SOBEL_X86
+
+__attribute__((target("sse4.2")))
+static void sobelRowSSE42(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const __m128 max_value = _mm_set1_ps(255.0f);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128 a0 = _mm_loadu_ps(row0 + x);
+        __m128 b0 = _mm_loadu_ps(row0 + x + 1);
+        __m128 c0 = _mm_loadu_ps(row0 + x + 2);
+        __m128 a1 = _mm_loadu_ps(row1 + x);
+        __m128 c1 = _mm_loadu_ps(row1 + x + 2);
+        __m128 a2 = _mm_loadu_ps(row2 + x);
+        __m128 b2 = _mm_loadu_ps(row2 + x + 1);
+        __m128 c2 = _mm_loadu_ps(row2 + x + 2);
+
+        __m128 diff1 = _mm_sub_ps(c1, a1);
+        __m128 sum_x = _mm_add_ps(
+            _mm_add_ps(_mm_sub_ps(c0, a0), _mm_sub_ps(c2, a2)), _mm_add_ps(diff1, diff1));
+        __m128 top = _mm_add_ps(_mm_add_ps(a0, c0), _mm_add_ps(b0, b0));
+        __m128 bottom = _mm_add_ps(_mm_add_ps(a2, c2), _mm_add_ps(b2, b2));
+        __m128 sum_y = _mm_sub_ps(bottom, top);
+
+        __m128 magnitude = _mm_sqrt_ps(
+            _mm_add_ps(_mm_mul_ps(sum_x, sum_x), _mm_mul_ps(sum_y, sum_y)));
+        _mm_storeu_ps(output + x, _mm_min_ps(magnitude, max_value));
+    }
+    sobelRowScalar(row0 + x, row1 + x, row2 + x, output + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void sobelRowAVX2(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const __m256 max_value = _mm256_set1_ps(255.0f);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256 a0 = _mm256_loadu_ps(row0 + x);
+        __m256 b0 = _mm256_loadu_ps(row0 + x + 1);
+        __m256 c0 = _mm256_loadu_ps(row0 + x + 2);
+        __m256 a1 = _mm256_loadu_ps(row1 + x);
+        __m256 c1 = _mm256_loadu_ps(row1 + x + 2);
+        __m256 a2 = _mm256_loadu_ps(row2 + x);
+        __m256 b2 = _mm256_loadu_ps(row2 + x + 1);
+        __m256 c2 = _mm256_loadu_ps(row2 + x + 2);
+
+        __m256 diff1 = _mm256_sub_ps(c1, a1);
+        __m256 sum_x = _mm256_add_ps(
+            _mm256_add_ps(_mm256_sub_ps(c0, a0), _mm256_sub_ps(c2, a2)),
+            _mm256_add_ps(diff1, diff1));
+        __m256 top = _mm256_add_ps(_mm256_add_ps(a0, c0), _mm256_add_ps(b0, b0));
+        __m256 bottom = _mm256_add_ps(_mm256_add_ps(a2, c2), _mm256_add_ps(b2, b2));
+        __m256 sum_y = _mm256_sub_ps(bottom, top);
+
+        __m256 magnitude = _mm256_sqrt_ps(
+            _mm256_add_ps(_mm256_mul_ps(sum_x, sum_x), _mm256_mul_ps(sum_y, sum_y)));
+        _mm256_storeu_ps(output + x, _mm256_min_ps(magnitude, max_value));
+    }
+    sobelRowScalar(row0 + x, row1 + x, row2 + x, output + x, width - x);
+}
+
+__attribute__((target("avx512f")))
+static void sobelRowAVX512(const float* row0, const float* row1,
+    const float* row2, float* output, int width
+) {
+    const __m512 max_value = _mm512_set1_ps(255.0f);
+    for (int x = 0; x < width; x += 16) {
+        // the tail is handled with masked loads and stores instead of scalar code
+        int remaining = width - x;
+        __mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+
+        __m512 a0 = _mm512_maskz_loadu_ps(mask, row0 + x);
+        __m512 b0 = _mm512_maskz_loadu_ps(mask, row0 + x + 1);
+        __m512 c0 = _mm512_maskz_loadu_ps(mask, row0 + x + 2);
+        __m512 a1 = _mm512_maskz_loadu_ps(mask, row1 + x);
+        __m512 c1 = _mm512_maskz_loadu_ps(mask, row1 + x + 2);
+        __m512 a2 = _mm512_maskz_loadu_ps(mask, row2 + x);
+        __m512 b2 = _mm512_maskz_loadu_ps(mask, row2 + x + 1);
+        __m512 c2 = _mm512_maskz_loadu_ps(mask, row2 + x + 2);
+
+        __m512 diff1 = _mm512_sub_ps(c1, a1);
+        __m512 sum_x = _mm512_add_ps(
+            _mm512_add_ps(_mm512_sub_ps(c0, a0), _mm512_sub_ps(c2, a2)),
+            _mm512_add_ps(diff1, diff1));
+        __m512 top = _mm512_add_ps(_mm512_add_ps(a0, c0), _mm512_add_ps(b0, b0));
+        __m512 bottom = _mm512_add_ps(_mm512_add_ps(a2, c2), _mm512_add_ps(b2, b2));
+        __m512 sum_y = _mm512_sub_ps(bottom, top);
+
+        __m512 magnitude = _mm512_sqrt_ps(
+            _mm512_add_ps(_mm512_mul_ps(sum_x, sum_x), _mm512_mul_ps(sum_y, sum_y)));
+        _mm512_mask_storeu_ps(output + x, mask, _mm512_min_ps(magnitude, max_value));
+    }
+}
+
+#endif
+
+SimdLevel detectSimdLevel() {
+#ifdef SOBEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return SimdLevel::SSE42;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+SobelRowKernel getSobelRowKernel(SimdLevel level) {
+    level = std::min(level, detectSimdLevel());
+#ifdef SOBEL_X86
+    switch (level) {
+        case SimdLevel::AVX512: return sobelRowAVX512;
+        case SimdLevel::AVX2: return sobelRowAVX2;
+        case SimdLevel::SSE42: return sobelRowSSE42;
+        case SimdLevel::Scalar: break;
+    }
+#endif
+    return sobelRowScalar;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::Scalar: break;
+    }
+    return "scalar";
+}
+
+bool parseSimdLevel(const std::string& name, SimdLevel* level) {
+    for (SimdLevel candidate : {SimdLevel::Scalar, SimdLevel::SSE42,
+            SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (name == simdLevelName(candidate)) {
+            *level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,28 @@
+#ifndef SOBEL_SIMD_H
+#define SOBEL_SIMD_H
+#include <string>
+
+enum class SimdLevel {
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+// Computes one output row of the clamped Sobel magnitude from three input
+// rows. Reads width + 2 pixels of each input row, writes width pixels.
+typedef void (*SobelRowKernel)(const float* row0, const float* row1,
+    const float* row2, float* output, int width);
+
+// widest instruction set both this build and the running CPU support
+SimdLevel detectSimdLevel();
+
+// falls back to the widest supported level below `level`
+SobelRowKernel getSobelRowKernel(SimdLevel level);
+
+const char* simdLevelName(SimdLevel level);
+
+// accepts the names printed by simdLevelName, returns false on anything else
+bool parseSimdLevel(const std::string& name, SimdLevel* level);
+
+#endif
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "bounded_queue.h"
+#include "edgedetect.h"
+#include "frame_stream.h"
+#include "synthetic_image.h"
+#include "trace.h"
+
+// Edge detection on a live frame sequence, one frame at a time in arrival
+// order. A reader thread takes frames off the input into a fixed set of frame
+// slots and the main thread computes and writes each one as soon as it can.
+// Frame slots, the output frame and the kernels' scratch buffers are all
+// allocated before the first frame, and the OpenMP team is created by the
+// warm-up runs, so a frame of the expected size allocates nothing. Latency is
+// measured per frame from the moment its last byte was read until its edges
+// were written and flushed, queueing behind earlier frames included.
+
+namespace {
+
+struct StreamConfig {
+    std::string algorithm = "canny";
+    std::string backend = "omp";
+    // frames read ahead while the main thread is busy, the reader blocks
+    // once they are all full
+    int queue_depth = 2;
+    // runs on a generated frame before the first real one
+    int warmup = 3;
+    std::string input_path = "-";
+    std::string output_path = "-";
+    std::string latency_csv_path;
+};
+
+StreamConfig parseStreamArgs(int argc, char** argv) {
+    StreamConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--algorithm=", 0) == 0) {
+            config.algorithm = arg.substr(12);
+        } else if (arg.rfind("--backend=", 0) == 0) {
+            config.backend = arg.substr(10);
+        } else if (arg.rfind("--queue-depth=", 0) == 0) {
+            config.queue_depth = std::max(1, atoi(arg.c_str() + 14));
+        } else if (arg.rfind("--warmup=", 0) == 0) {
+            config.warmup = std::max(0, atoi(arg.c_str() + 9));
+        } else if (arg.rfind("--input=", 0) == 0) {
+            config.input_path = arg.substr(8);
+        } else if (arg.rfind("--output=", 0) == 0) {
+            config.output_path = arg.substr(9);
+        } else if (arg.rfind("--latency-csv=", 0) == 0) {
+            config.latency_csv_path = arg.substr(14);
+        }
+    }
+    return config;
+}
+
+struct Frame {
+    ImageBuffer<uint8_t> pixels;
+    chrono::steady_clock::time_point arrival;
+};
+
+// Fills free frame slots from the reader and hands them to the main thread
+// in order. Slots go back to `free_frames` once their edges are written
+struct FrameQueue {
+    FrameReader& reader;
+    std::vector<Frame> slots;
+    BoundedQueue<Frame*> free_frames;
+    BoundedQueue<Frame*> ready_frames;
+    std::atomic<bool> reader_finished;
+    // set when the main thread gives up early, e.g. because the output failed
+    std::atomic<bool> stopped;
+    // set by the reader thread before reader_finished if the stream was malformed
+    std::string error;
+    std::thread thread;
+
+    FrameQueue(FrameReader& reader, int depth):
+        reader(reader), slots(depth), free_frames(depth), ready_frames(depth),
+        reader_finished(false), stopped(false)
+    {
+        for (auto& slot : slots) {
+            slot.pixels = ImageBuffer<uint8_t>(reader.width, reader.height);
+            free_frames.tryPush(&slot);
+        }
+    }
+
+    void start() {
+        thread = std::thread(&FrameQueue::readLoop, this);
+    }
+
+    void readLoop() {
+        try {
+            while (true) {
+                Frame* frame = nullptr;
+                Backoff backoff;
+                while (!free_frames.tryPop(&frame)) {
+                    if (stopped.load(std::memory_order_acquire)) { return; }
+                    backoff.wait();
+                }
+                if (!reader.readFrame(&frame->pixels)) { break; }
+                frame->arrival = chrono::steady_clock::now();
+
+                backoff = Backoff();
+                while (!ready_frames.tryPush(frame)) {
+                    if (stopped.load(std::memory_order_acquire)) { return; }
+                    backoff.wait();
+                }
+            }
+        } catch (std::runtime_error& e) {
+            error = e.what();
+        }
+        reader_finished.store(true, std::memory_order_release);
+    }
+
+    // blocks until a frame has arrived, nullptr at the end of the stream
+    Frame* next() {
+        Frame* frame = nullptr;
+        Backoff backoff;
+        while (!ready_frames.tryPop(&frame)) {
+            if (reader_finished.load(std::memory_order_acquire)) {
+                // the reader may have pushed its last frame just before finishing
+                return ready_frames.tryPop(&frame) ? frame : nullptr;
+            }
+            backoff.wait();
+        }
+        return frame;
+    }
+
+    void release(Frame* frame) {
+        free_frames.tryPush(frame);
+    }
+
+    // a reader blocked on the input still finishes the frame it is reading
+    ~FrameQueue() {
+        stopped.store(true, std::memory_order_release);
+        if (thread.joinable()) { thread.join(); }
+    }
+};
+
+void writeLatencyCSV(const std::string& path, const std::vector<long long>& compute_ns,
+    const std::vector<long long>& latency_ns
+) {
+    std::ofstream file(path);
+    file << "frame,compute_ns,latency_ns\n";
+    for (size_t i = 0; i < latency_ns.size(); ++i) {
+        file << i << "," << compute_ns[i] << "," << latency_ns[i] << "\n";
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to save latencies: " + path);
+    }
+}
+
+void printLatency(std::ostream& log, const char* name, const std::vector<long long>& samples) {
+    StageStats stats = summarize(samples);
+    log << name << " (us): p50 " << stats.median / 1000 << ", p95 " << stats.p95 / 1000
+        << ", p99 " << stats.p99 / 1000 << ", max " << stats.max / 1000 << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    StreamConfig config = parseStreamArgs(argc, argv);
+    bool verbose = false;
+    EdgeParams params;
+    params.sobel = parseSobelArgs(argc, argv, &verbose);
+    params.canny = parseCannyArgs(argc, argv, &verbose);
+    std::string trace_path = parseTraceArg(argc, argv);
+
+    // edge frames may go to stdout, so everything else goes to stderr then
+    std::ostream& log = config.output_path == "-" ? std::cerr : std::cout;
+    if (config.algorithm != "sobel" && config.algorithm != "canny") {
+        std::cerr << "Unknown algorithm [" << config.algorithm << "]" << std::endl;
+        return 1;
+    }
+    if (config.backend != "seq" && config.backend != "omp" && config.backend != "cuda") {
+        std::cerr << "Unknown backend [" << config.backend << "]" << std::endl;
+        return 1;
+    }
+    EdgeAlgorithm algorithm = config.algorithm == "sobel" ?
+        EdgeAlgorithm::Sobel : EdgeAlgorithm::Canny;
+    EdgeBackend backend = config.backend == "seq" ? EdgeBackend::Sequential :
+        config.backend == "omp" ? EdgeBackend::OpenMP : EdgeBackend::CUDA;
+
+    log << "==========Frame Stream==========" << std::endl;
+    std::vector<long long> compute_ns;
+    std::vector<long long> latency_ns;
+    // grown in large steps, not once per frame
+    compute_ns.reserve(1 << 16);
+    latency_ns.reserve(1 << 16);
+    size_t warm_allocations = 0;
+    try {
+        // blocks until the stream header, or the first PGM header, arrives
+        FrameReader reader(config.input_path);
+        FrameWriter writer(config.output_path, reader.format, reader.frame_rate);
+        log << "Frames: " << reader.width << "x" << reader.height << ", "
+            << (reader.format == FrameFormat::Y4M ? "Y4M" : "PGM") << std::endl;
+
+        FrameQueue frames(reader, config.queue_depth);
+        ImageBuffer<uint8_t> edges(edgeOutputWidth(algorithm, reader.width, params),
+            edgeOutputHeight(algorithm, reader.height, params));
+        {
+            // a frame with many edges, so hysteresis grows its stacks and
+            // labels to what a busy real frame needs
+            ImageBuffer<uint8_t> warm_frame = syntheticImage(SyntheticPattern::EdgeDense,
+                reader.width, reader.height);
+            for (int i = 0; i < config.warmup; ++i) {
+                detectEdges(warm_frame.view(), edges.view(), algorithm, backend, params);
+            }
+        }
+        warm_allocations = bufferPoolStats().heap_allocations;
+
+        traceStart(0, "Frame Stream");
+        frames.start();
+        while (Frame* frame = frames.next()) {
+            auto compute_start = chrono::steady_clock::now();
+            if (edgeOutputWidth(algorithm, frame->pixels.width, params) != edges.width ||
+                    edgeOutputHeight(algorithm, frame->pixels.height, params) != edges.height) {
+                // only PGM streams change size, this frame and its buffers are
+                // allocated anew and the blocks of the old size are freed
+                edges = ImageBuffer<uint8_t>();
+                bufferPoolTrim();
+                edges = ImageBuffer<uint8_t>(
+                    edgeOutputWidth(algorithm, frame->pixels.width, params),
+                    edgeOutputHeight(algorithm, frame->pixels.height, params));
+            }
+            detectEdges(frame->pixels.view(), edges.view(), algorithm, backend, params);
+            auto compute_end = chrono::steady_clock::now();
+            writer.writeFrame(edges.view());
+            auto written = chrono::steady_clock::now();
+
+            compute_ns.push_back(chrono::duration_cast<chrono::nanoseconds>(
+                compute_end - compute_start).count());
+            latency_ns.push_back(chrono::duration_cast<chrono::nanoseconds>(
+                written - frame->arrival).count());
+            frames.release(frame);
+            if (verbose) {
+                log << "Frame " << latency_ns.size() - 1 << ": latency "
+                    << latency_ns.back() / 1000 << " us" << std::endl;
+            }
+        }
+        if (!frames.error.empty()) {
+            throw std::runtime_error(frames.error);
+        }
+        if (!config.latency_csv_path.empty()) {
+            writeLatencyCSV(config.latency_csv_path, compute_ns, latency_ns);
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    log << "Frames processed: " << latency_ns.size() << std::endl;
+    if (!latency_ns.empty()) {
+        printLatency(log, "Compute", compute_ns);
+        printLatency(log, "Latency", latency_ns);
+    }
+    BufferPoolStats pool_stats = bufferPoolStats();
+    log << "Image buffers: " << pool_stats.heap_allocations << " allocated, "
+        << pool_stats.reuses << " reused, "
+        << pool_stats.heap_allocations - warm_allocations << " after warm-up" << std::endl;
+    if (!trace_path.empty()) {
+        writeTrace(trace_path);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include "synthetic_image.h"
+
+namespace {
+
+// mt19937 output is fixed by the standard, unlike the distributions, so the
+// top byte of each draw is the same everywhere
+uint8_t randomLevel(std::mt19937& random) {
+    return (uint8_t)(random() >> 24);
+}
+
+}
+
+const char* syntheticPatternName(SyntheticPattern pattern) {
+    switch (pattern) {
+        case SyntheticPattern::Noise: return "noise";
+        case SyntheticPattern::Gradient: return "gradient";
+        case SyntheticPattern::Checkerboard: return "checkerboard";
+        case SyntheticPattern::EdgeDense: return "dense";
+        case SyntheticPattern::EdgeSparse: return "sparse";
+    }
+    return "unknown";
+}
+
+SyntheticPattern parseSyntheticPattern(const std::string& name) {
+    for (SyntheticPattern pattern : allSyntheticPatterns()) {
+        if (name == syntheticPatternName(pattern)) {
+            return pattern;
+        }
+    }
+    throw std::runtime_error("Unknown pattern: " + name);
+}
+
+const std::vector<SyntheticPattern>& allSyntheticPatterns() {
+    static const std::vector<SyntheticPattern> patterns = {
+        SyntheticPattern::Noise, SyntheticPattern::Gradient, SyntheticPattern::Checkerboard,
+        SyntheticPattern::EdgeDense, SyntheticPattern::EdgeSparse};
+    return patterns;
+}
+
+ImageBuffer<uint8_t> syntheticImage(SyntheticPattern pattern, int width, int height,
+    uint32_t seed
+) {
+    ImageBuffer<uint8_t> image(width, height);
+    std::mt19937 random(seed);
+
+    switch (pattern) {
+    case SyntheticPattern::Noise:
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                image[y][x] = randomLevel(random);
+            }
+        }
+        break;
+
+    case SyntheticPattern::Gradient: {
+        long long span = std::max(1LL, (long long)width + height - 2);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                image[y][x] = (uint8_t)(255LL * (x + y) / span);
+            }
+        }
+        break;
+    }
+
+    case SyntheticPattern::Checkerboard:
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                image[y][x] = ((x / 16 + y / 16) % 2) ? 224 : 32;
+            }
+        }
+        break;
+
+    case SyntheticPattern::EdgeDense: {
+        // one level per square of a row of squares, drawn before its rows
+        const int cell = 4;
+        std::vector<uint8_t> levels((width + cell - 1) / cell);
+        for (int y = 0; y < height; ++y) {
+            if (y % cell == 0) {
+                for (auto& level : levels) {
+                    level = randomLevel(random);
+                }
+            }
+            for (int x = 0; x < width; ++x) {
+                image[y][x] = levels[x / cell];
+            }
+        }
+        break;
+    }
+
+    case SyntheticPattern::EdgeSparse: {
+        long long center_x = width / 2;
+        long long center_y = height / 2;
+        long long radius = std::min(width, height) / 4;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                long long dx = x - center_x;
+                long long dy = y - center_y;
+                image[y][x] = dx * dx + dy * dy <= radius * radius ? 192 : 96;
+            }
+        }
+        break;
+    }
+    }
+    return image;
+}
@@ -0,0 +1,35 @@
+#ifndef SYNTHETIC_IMAGE_H
+#define SYNTHETIC_IMAGE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "image_buffer.h"
+
+// Generated grey images for timing the kernels at any size, and on content
+// the dataset does not have. The pixels only depend on the pattern, the size
+// and the seed, so runs on different machines see the same image.
+enum class SyntheticPattern {
+    // every pixel independent and uniform, edges everywhere
+    Noise,
+    // one smooth diagonal ramp, weak gradients and no edges
+    Gradient,
+    // black and white squares of 16 pixels, long straight edges
+    Checkerboard,
+    // 4 pixel squares of random grey, an edge around almost every square
+    EdgeDense,
+    // a disc on a flat background, edges on one thin ring only
+    EdgeSparse
+};
+
+// noise, gradient, checkerboard, dense or sparse
+const char* syntheticPatternName(SyntheticPattern pattern);
+
+// Inverse of syntheticPatternName. Throws std::runtime_error on an unknown name
+SyntheticPattern parseSyntheticPattern(const std::string& name);
+
+const std::vector<SyntheticPattern>& allSyntheticPatterns();
+
+ImageBuffer<uint8_t> syntheticImage(SyntheticPattern pattern, int width, int height,
+    uint32_t seed = 1);
+
+#endif
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "trace.h"
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    long long start_ns;
+    long long duration_ns;
+};
+
+// Events of one thread. Only that thread appends, so recording takes no
+// lock. The list of threads outlives them, so the spans of finished decode
+// and encode threads are still written
+struct ThreadTrace {
+    int tid;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceState {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTrace>> threads;
+    std::atomic<long long> epoch_ns{0};
+    int pid = 0;
+    std::string process_name = "edge detection";
+};
+
+TraceState& traceState() {
+    static TraceState state;
+    return state;
+}
+
+long long steadyNs() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+[[maybe_unused]] ThreadTrace& threadTrace() {
+    thread_local std::shared_ptr<ThreadTrace> trace;
+    if (!trace) {
+        TraceState& state = traceState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        trace = std::make_shared<ThreadTrace>();
+        trace->tid = (int)state.threads.size();
+        state.threads.push_back(trace);
+    }
+    return *trace;
+}
+
+// Chrome traces count in microseconds, fractions keep the nanoseconds
+std::string microseconds(long long ns) {
+    std::ostringstream stream;
+    stream << ns / 1000 << "." << (ns % 1000) / 100 << (ns % 100) / 10 << ns % 10;
+    return stream.str();
+}
+
+}
+
+#ifdef EDGE_TRACE
+TraceScope::TraceScope(const char* name): name(name), start_ns(steadyNs()) {}
+
+TraceScope::~TraceScope() {
+    long long end_ns = steadyNs();
+    threadTrace().events.push_back({name, start_ns, end_ns - start_ns});
+}
+#endif
+
+std::string parseTraceArg(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--trace=", 0) == 0) {
+            return arg.substr(8);
+        }
+    }
+    return "";
+}
+
+void traceStart(int pid, const std::string& process_name) {
+    TraceState& state = traceState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (auto& thread : state.threads) {
+        thread->events.clear();
+    }
+    state.pid = pid;
+    state.process_name = process_name;
+    state.epoch_ns = steadyNs();
+}
+
+std::string traceEventsJson() {
+    TraceState& state = traceState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    long long epoch_ns = state.epoch_ns;
+    std::ostringstream json;
+    json << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << state.pid
+        << ", \"args\": {\"name\": \"" << state.process_name << "\"}}";
+
+    for (auto& thread : state.threads) {
+        json << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << state.pid
+            << ", \"tid\": " << thread->tid << ", \"args\": {\"name\": \"Thread "
+            << thread->tid << "\"}}";
+        for (const TraceEvent& event : thread->events) {
+            // spans that started before traceStart are clipped to it
+            long long start_ns = std::max(event.start_ns - epoch_ns, 0LL);
+            json << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"ts\": "
+                << microseconds(start_ns) << ", \"dur\": " << microseconds(event.duration_ns)
+                << ", \"pid\": " << state.pid << ", \"tid\": " << thread->tid << "}";
+        }
+    }
+    return json.str();
+}
+
+void writeTraceEvents(const std::string& path, const std::string& events_json) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to write trace: " + path);
+    }
+    file << "{\"traceEvents\": [\n" << events_json << "\n]}\n";
+}
+
+void writeTrace(const std::string& path) {
+    if (!trace_enabled) {
+        std::cerr << "Tracing is not compiled in, rebuild with -DEDGE_TRACE=ON to write ["
+            << path << "]" << std::endl;
+        return;
+    }
+    writeTraceEvents(path, traceEventsJson());
+}
@@ -0,0 +1,51 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <string>
+
+// Spans around the stages, image I/O and MPI calls, written as a Chrome trace
+// JSON file that Perfetto (ui.perfetto.dev) or chrome://tracing opens. Every
+// thread gets its own track, and in the MPI executables every rank its own
+// process. Spans are only compiled in with -DEDGE_TRACE (cmake -DEDGE_TRACE=ON),
+// otherwise TRACE_SCOPE expands to nothing and the hot paths are unchanged.
+
+#ifdef EDGE_TRACE
+// records the time from here to the end of the enclosing scope. Names must
+// be string literals, they are kept as pointers
+struct TraceScope {
+    const char* name;
+    long long start_ns;
+
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+const bool trace_enabled = true;
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+const bool trace_enabled = false;
+#endif
+
+// reads --trace=<file>, empty if not given
+std::string parseTraceArg(int argc, char** argv);
+
+// Drops what was recorded so far and starts the clock at zero. pid and
+// process_name label this process in the trace
+void traceStart(int pid, const std::string& process_name);
+
+// The recorded events of every thread as comma separated JSON objects, for
+// merging traces of several processes. Call when no traced work is running
+std::string traceEventsJson();
+
+// Writes {"traceEvents": [...]} to path. Without EDGE_TRACE this only warns
+// that there is nothing to write. Throws std::runtime_error if the file
+// cannot be written
+void writeTrace(const std::string& path);
+void writeTraceEvents(const std::string& path, const std::string& events_json);
+
+#endif